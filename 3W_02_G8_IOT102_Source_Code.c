@@ -17,6 +17,9 @@
 #define BLYNK_TEMPLATE_ID "TMPL6M3zYgiyV"
 #define BLYNK_TEMPLATE_NAME "Smart Digital Clock"
 #define BLYNK_AUTH_TOKEN "hxZ9BuGKx3jo4L0ogs0SjRyB2EeN9RoO"
+// Point the device at tools/blynk_server.py instead of the cloud
+// #define BLYNK_LOCAL_SERVER "192.168.1.10"
+// #define BLYNK_LOCAL_PORT   8080
 
 // ========== LIBRARIES (AFTER BLYNK DEFINES) ==========
 #include <ESP8266WiFi.h>
@@ -24,7 +27,6 @@
 #include <Wire.h>
 #include <DS1302.h>
 #include <LiquidCrystal_I2C.h>
-#include <DHT.h>
 #include <MAX30105.h>
 #include <heartRate.h>
 #include <EEPROM.h>
@@ -33,11 +35,12 @@
 char ssid[] = "Phat";
 char pass[] = "12345678";
 
-// WiFi connection timeout
-const unsigned long WIFI_TIMEOUT = 15000; // 15 seconds
-bool wifiConnected = false;
-unsigned long lastWiFiCheck = 0;
-const unsigned long WIFI_CHECK_INTERVAL = 30000; // Check every 30s
+// Connection attempts (see WIFI MANAGEMENT)
+const unsigned long WIFI_TIMEOUT = 15000;        // Per WiFi attempt
+const unsigned long BLYNK_LOGIN_TIMEOUT = 15000;
+const unsigned long WIFI_BACKOFF_MIN = 2000;
+const unsigned long WIFI_BACKOFF_MAX = 300000;   // 5 min
+bool wifiConnected = false;   // WiFi and Blynk both up
 
 // ========== PIN DEFINITIONS ==========
 #define DHT_PIN        D3
@@ -46,6 +49,26 @@ const unsigned long WIFI_CHECK_INTERVAL = 30000; // Check every 30s
 #define RTC_RST_PIN    D8
 #define BUTTON_PIN     D6
 #define BUZZER_PIN     D7
+// #define PPG_INT_PIN    D0   // Optional: MAX30102 INT (active low)
+#define LCD_I2C_ADDR   0x27
+
+// MAX30102 and LCD share the bus, which runs at the 100 kHz the PCF8574
+// on the LCD backpack is rated for. Many modules work at 400 kHz, about
+// 4x faster LCD updates; define I2C_FAST to try it, and drop it again if
+// the display shows garbage.
+// #define I2C_FAST
+#ifdef I2C_FAST
+const uint32_t I2C_CLOCK = 400000;
+#else
+const uint32_t I2C_CLOCK = 100000;
+#endif
+
+// ========== TRACE CONFIG ==========
+// TRACE_RECORD streams every sensor input as binary records on Serial;
+// TRACE_REPLAY takes the inputs from such a stream instead of the
+// hardware (see TRACE RECORDER and tools/trace.py). Enable at most one.
+// #define TRACE_RECORD
+// #define TRACE_REPLAY
 
 // ========== BLYNK VIRTUAL PINS ==========
 #define V_TIME         V0
@@ -62,26 +85,144 @@ const unsigned long WIFI_CHECK_INTERVAL = 30000; // Check every 30s
 #define V_AUTO_MODE    V11
 #define V_SELECT_MODE  V12
 #define V_NEXT_MODE    V13
+#define V_ALARM_SLOT   V14
+#define V_ALARM_DAYS   V15
+#define V_SNOOZE       V16
+#define V_HRV_RMSSD    V17
+#define V_HRV_SDNN     V18
+#define V_HRV_PNN50    V19
+#define V_PROFILE      V20
+#define V_RULE_SLOT    V21
+#define V_RULE_THRESHOLD V22
+#define V_RULE_HYSTERESIS V23
+#define V_RULE_DWELL   V24
+#define V_RULE_COOLDOWN V25
+#define V_RULE_ENABLED V26
 
 // ========== OBJECTS ==========
-DHT dht(DHT_PIN, DHT11);
 DS1302 rtc(RTC_RST_PIN, RTC_DAT_PIN, RTC_CLK_PIN);
-LiquidCrystal_I2C lcd(0x27, 16, 2);
+LiquidCrystal_I2C lcdDriver(LCD_I2C_ADDR, 16, 2);
 MAX30105 particleSensor;
 BlynkTimer timer;
 
 // ========== ALARM STRUCTURE ==========
 struct AlarmData {
-  int hour;
-  int minute;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t days;     // Bit 0 = Monday ... bit 6 = Sunday, 0 = once
+  bool enabled;
+};
+
+#define ALARM_COUNT     4
+#define ALARM_EVERY_DAY 0x7F
+
+AlarmData alarms[ALARM_COUNT] = {
+  {7, 0, ALARM_EVERY_DAY, false},
+  {7, 0, ALARM_EVERY_DAY, false},
+  {7, 0, ALARM_EVERY_DAY, false},
+  {7, 0, ALARM_EVERY_DAY, false},
+};
+uint8_t selectedAlarm = 0;   // Slot edited from the Blynk app
+
+// ========== PPG SAMPLE STRUCTURE ==========
+struct PpgSample {
+  unsigned long time;
+  uint32_t ir;
+  uint32_t red;
+};
+
+// ========== ROLLUP STRUCTURES ==========
+// One metric over one time bucket, fixed point (see ROLLUPS)
+struct RollupCell {
+  int16_t min;
+  int16_t max;
+  int16_t mean;
+};
+
+struct RollupAccum {
+  int16_t min;
+  int16_t max;
+  int32_t sum;
+  uint16_t count;
+};
+
+// ========== DISPLAY PAGE STRUCTURES ==========
+// Each LCD page is a compile-time table (see DISPLAY PAGES). Labels are
+// drawn once when the page is entered. A field is rendered again whenever
+// millis() crosses a multiple of its period and is written padded to its
+// width; the LCD HAL then sends only the cells that changed.
+struct PageLabel {
+  uint8_t col;
+  uint8_t row;
+  const char* text;
+};
+
+struct PageField {
+  uint8_t col;
+  uint8_t row;
+  uint8_t width;
+  uint16_t period;              // ms, 0: only when the page is entered
+  void (*render)(char* buffer, size_t size);
+};
+
+struct DisplayPage {
+  const char* name;
+  const PageLabel* labels;
+  uint8_t labelCount;
+  const PageField* fields;
+  uint8_t fieldCount;
+  void (*prepare)();            // Optional, before due fields render
+  void (*longPress)();          // Optional button actions for this page
+  void (*holdRepeat)();
+};
+
+// ========== HEALTH RULE STRUCTURE ==========
+// Thresholds are in the source's units: BPM, or 0.1 °C (see HEALTH RULES)
+struct HealthRule {
+  int16_t threshold;
+  uint8_t hysteresis;   // Episode ends once back past threshold by this
+  uint8_t dwell;        // s past the threshold before the rule fires
+  uint16_t cooldown;    // s between firings, 0 = once per episode
   bool enabled;
 };
 
-AlarmData alarm = {7, 0, false};
+enum HealthSource {
+  SOURCE_HEART_RATE,
+  SOURCE_TEMPERATURE
+};
+
+struct HealthRuleInfo {
+  const char* name;
+  uint8_t source;
+  bool below;           // Fires at or below the threshold, else at or above
+};
+
+enum HealthRuleId {
+  RULE_HR_HIGH,
+  RULE_HR_LOW,
+  RULE_TEMP_HIGH,
+  RULE_COUNT
+};
+
+const HealthRuleInfo RULE_INFO[RULE_COUNT] = {
+  {"hr_high", SOURCE_HEART_RATE, false},
+  {"hr_low", SOURCE_HEART_RATE, true},
+  {"temp_high", SOURCE_TEMPERATURE, false},
+};
+
+// The previous fixed checks as rules. Heart rate already compared with
+// >= / <=; the temperature check was > 35.0 °C, so with rules firing at
+// the threshold temp_high sits one step higher and still fires from 35.1.
+HealthRule healthRules[RULE_COUNT] = {
+  {100, 0, 10, 0, true},
+  {60, 0, 10, 0, true},
+  {351, 0, 0, 30, true},
+};
+uint8_t selectedRule = 0;    // Rule edited from the Blynk app
 
 // ========== GLOBAL VARIABLES ==========
-float temperature = 0.0;
-float humidity = 0.0;
+int16_t temperature = 0;    // 0.1 °C
+int16_t humidity = 0;       // 0.1 %
 int heartRate = 0;
 uint8_t beatsPerMinute = 0;
 uint32_t irValue = 0;
@@ -97,880 +238,3809 @@ bool alarmRinging = false;
 unsigned long alarmStartTime = 0;
 const unsigned long ALARM_DURATION = 60000;
 
+// Alarm scheduler (epoch seconds, see ALARM SCHEDULER)
+const uint32_t ALARM_NONE = 0xFFFFFFFF;
+const uint32_t ALARM_CATCHUP_WINDOW = 600;   // s, older misses are skipped
+const uint32_t SNOOZE_DURATION = 300;        // s
+uint32_t nextAlarmEpoch = ALARM_NONE;
+uint8_t nextAlarmSlot = 0;
+uint32_t snoozeUntil = ALARM_NONE;
+uint8_t ringingAlarm = 0;
+
 unsigned long lastBuzzerToggle = 0;
 bool buzzerState = false;
 
-bool lastButtonState = HIGH;
-bool buttonState = HIGH;
-unsigned long lastDebounceTime = 0;
 const unsigned long DEBOUNCE_DELAY = 50;
 
-const int HR_HIGH = 100;
-const int HR_LOW = 60;
-const float TEMP_HIGH = 35.0;
+unsigned long lastBeat = 0;
+int hrConfidence = 0;   // 0-100, how consistent recent beat intervals are
 
-const byte RATE_SIZE = 4;
-byte rates[RATE_SIZE];
-byte rateSpot = 0;
-long lastBeat = 0;
-
-const char* MODE_NAMES[] = {"Time+Temp", "Heart Rate", "Full Info"};
+// Heart rate variability over the last HRV_WINDOW accepted intervals
+const uint8_t HRV_WINDOW = 64;
+const uint8_t HRV_MIN_INTERVALS = 16;
+uint8_t hrvCount = 0;
+int hrvRmssd = 0;       // ms
+int hrvSdnn = 0;        // ms
+int hrvPnn50 = 0;       // %
 
 bool alarmMuted = false;
 unsigned long lastFingerRemoved = 0;
+uint32_t ppgDropped = 0;
 
-// Sensor reading intervals for offline mode
-unsigned long lastSensorRead = 0;
-const unsigned long SENSOR_READ_INTERVAL = 2000;
 
-// Health warning tracking
-unsigned long hrDangerStartTime = 0;
-bool hrInDangerZone = false;
-bool hrWarningActive = false;
-const unsigned long HR_DANGER_DURATION = 10000; // 10 seconds
-unsigned long lastHrWarningBeep = 0;
+// ========== TRACE RECORDER ==========
+// Record layout (little endian):
+//   A5 | type | len | time (u32, ms) | payload[len] | crc8
+// crc8 uses polynomial 0x07 over type..payload. Serial text logging keeps
+// running alongside, so readers scan for the sync byte and drop frames
+// whose CRC does not match. Payloads:
+//   TRACE_HEADER  version
+//   TRACE_PPG     count, then count x (red u24, ir u24)
+//   TRACE_DHT     ok, humidity i16, temperature i16 (0.1 units)
+//   TRACE_RTC     year u16, mon, date, hour, min, sec, dow
+//   TRACE_BUTTON  level, edge time u32 (ms)
+//   TRACE_BLYNK   pin, value i32 (writes from the app)
+const uint8_t TRACE_SYNC = 0xA5;
+const uint8_t TRACE_VERSION = 3;
+const uint8_t TRACE_PPG_MAX = 32;     // Samples per record (FIFO depth)
+const uint8_t TRACE_MAX_PAYLOAD = 1 + TRACE_PPG_MAX * 6;
+const uint8_t TRACE_FRAME_OVERHEAD = 8;
+const unsigned long TRACE_BAUD = 921600;
 
-// ========== HELPER FUNCTIONS ==========
-String getTimeString() {
-  Time t = rtc.getTime();
-  char buffer[10];
-  sprintf(buffer, "%02d:%02d:%02d", t.hour, t.min, t.sec);
-  return String(buffer);
+enum TraceType {
+  TRACE_HEADER = 0,
+  TRACE_PPG,
+  TRACE_DHT,
+  TRACE_RTC,
+  TRACE_BUTTON,
+  TRACE_BLYNK
+};
+
+uint8_t traceCrc8(const uint8_t* data, uint8_t len, uint8_t crc) {
+  for (uint8_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
 }
 
-String getDateString() {
-  Time t = rtc.getTime();
-  char buffer[12];
-  sprintf(buffer, "%02d/%02d/%04d", t.date, t.mon, t.year);
-  return String(buffer);
+void tracePut16(uint8_t* p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
 }
 
-// ========== HEART RATE READING ==========
-void readHeartRate() {
-  irValue = particleSensor.getIR();
+void tracePut24(uint8_t* p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+}
 
-  if (irValue > 50000 && irValue < 200000) {
-    fingerDetected = true;
-  } else {
-    if (fingerDetected) {
-      lastFingerRemoved = millis();
-    }
-    fingerDetected = false;
-  }
+void tracePut32(uint8_t* p, uint32_t v) {
+  tracePut16(p, v);
+  tracePut16(p + 2, v >> 16);
+}
 
-  if (fingerDetected && checkForBeat(irValue)) {
-    long delta = millis() - lastBeat;
-    lastBeat = millis();
+uint16_t traceGet16(const uint8_t* p) {
+  return p[0] | (uint16_t)p[1] << 8;
+}
 
-    float bpm = 60.0 / (delta / 1000.0);
+uint32_t traceGet24(const uint8_t* p) {
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+}
 
-    if (bpm > 20 && bpm < 200) {
-      rates[rateSpot++] = (byte)bpm;
-      rateSpot %= RATE_SIZE;
+uint32_t traceGet32(const uint8_t* p) {
+  return traceGet16(p) | (uint32_t)traceGet16(p + 2) << 16;
+}
 
-      heartRate = 0;
-      for (byte i = 0; i < RATE_SIZE; i++) {
-        heartRate += rates[i];
-      }
-      heartRate /= RATE_SIZE;
-    }
-  }
+#ifdef TRACE_RECORD
+void traceEmit(uint8_t type, const uint8_t* payload, uint8_t len) {
+  uint8_t head[7];
+  head[0] = TRACE_SYNC;
+  head[1] = type;
+  head[2] = len;
+  tracePut32(head + 3, millis());
+  uint8_t crc = traceCrc8(head + 1, sizeof(head) - 1, 0);
+  crc = traceCrc8(payload, len, crc);
+  Serial.write(head, sizeof(head));
+  Serial.write(payload, len);
+  Serial.write(crc);
+}
+#endif
 
-  if (!fingerDetected && millis() - lastFingerRemoved > 2000) {
-    heartRate = 0;
-    for (byte i = 0; i < RATE_SIZE; i++) rates[i] = 0;
-  }
+void traceBegin() {
+#ifdef TRACE_RECORD
+  uint8_t version = TRACE_VERSION;
+  traceEmit(TRACE_HEADER, &version, 1);
+#endif
 }
 
-// ========== SENSOR READING ==========
-void readSensors() {
-  float h = dht.readHumidity();
-  float t = dht.readTemperature();
-  
-  if (!isnan(h) && !isnan(t)) {
-    humidity = h;
-    temperature = t;
+void tracePpg(const uint32_t* red, const uint32_t* ir, uint8_t count) {
+#ifdef TRACE_RECORD
+  if (count == 0) return;
+  uint8_t buf[TRACE_MAX_PAYLOAD];
+  buf[0] = count;
+  for (uint8_t i = 0; i < count; i++) {
+    tracePut24(buf + 1 + i * 6, red[i]);
+    tracePut24(buf + 4 + i * 6, ir[i]);
   }
+  traceEmit(TRACE_PPG, buf, 1 + count * 6);
+#endif
 }
 
-// ========== BLYNK WRITE HANDLERS ==========
-BLYNK_WRITE(V_ALARM_HOUR) {
-  alarm.hour = param.asInt();
-  saveAlarm();
-  Blynk.virtualWrite(V_TERMINAL, 
-    String("[") + getTimeString() + "] Alarm hour: " + String(alarm.hour) + "\n");
-  updateStatusDisplay();
-  Serial.printf("[BLYNK] Alarm hour: %02d\n", alarm.hour);
+void traceDht(bool ok, int16_t h, int16_t t) {
+#ifdef TRACE_RECORD
+  uint8_t buf[5];
+  buf[0] = ok;
+  tracePut16(buf + 1, h);
+  tracePut16(buf + 3, t);
+  traceEmit(TRACE_DHT, buf, sizeof(buf));
+#endif
 }
 
-BLYNK_WRITE(V_ALARM_MIN) {
-  alarm.minute = param.asInt();
-  saveAlarm();
-  Blynk.virtualWrite(V_TERMINAL, 
-    String("[") + getTimeString() + "] Alarm minute: " + String(alarm.minute) + "\n");
-  updateStatusDisplay();
-  Serial.printf("[BLYNK] Alarm minute: %02d\n", alarm.minute);
+void traceRtc(const Time &t) {
+#ifdef TRACE_RECORD
+  uint8_t buf[8];
+  tracePut16(buf, t.year);
+  buf[2] = t.mon;
+  buf[3] = t.date;
+  buf[4] = t.hour;
+  buf[5] = t.min;
+  buf[6] = t.sec;
+  buf[7] = t.dow;
+  traceEmit(TRACE_RTC, buf, sizeof(buf));
+#endif
 }
 
-BLYNK_WRITE(V_ALARM_EN) {
-  alarm.enabled = param.asInt();
-  saveAlarm();
-  String status = alarm.enabled ? "ENABLED" : "DISABLED";
-  Blynk.virtualWrite(V_TERMINAL, 
-    String("[") + getTimeString() + "] Alarm " + status + "\n");
-  updateStatusDisplay();
-  Serial.printf("[BLYNK] Alarm %s\n", status.c_str());
+void traceButton(bool level, uint32_t time) {
+#ifdef TRACE_RECORD
+  uint8_t buf[5];
+  buf[0] = level;
+  tracePut32(buf + 1, time);
+  traceEmit(TRACE_BUTTON, buf, sizeof(buf));
+#endif
 }
 
-BLYNK_WRITE(V_STOP_ALARM) {
-  int buttonState = param.asInt();
-  if (buttonState == 1 && alarmRinging) {
-    stopAlarmSound("Blynk App");
-  }
+void traceBlynkWrite(uint8_t pin, int32_t value) {
+#ifdef TRACE_RECORD
+  uint8_t buf[5];
+  buf[0] = pin;
+  tracePut32(buf + 1, value);
+  traceEmit(TRACE_BLYNK, buf, sizeof(buf));
+#endif
 }
 
-BLYNK_WRITE(V_AUTO_MODE) {
-  autoModeSwitch = param.asInt();
-  String status = autoModeSwitch ? "ENABLED" : "DISABLED";
-  Blynk.virtualWrite(V_TERMINAL, 
-    String("[") + getTimeString() + "] Auto mode: " + status + "\n");
-  Serial.println("[MODE] Auto switch: " + status);
-  if (autoModeSwitch) {
-    lastModeSwitch = millis();
-  }
-  forceUpdate = true;
+// Replay: frames arrive on Serial (paced by tools/trace.py) and are
+// applied once the sketch's clock reaches their recorded time, relative
+// to the first frame. The HAL read functions then return the replayed
+// values instead of touching the hardware.
+#ifdef TRACE_REPLAY
+uint8_t replayFrame[TRACE_MAX_PAYLOAD + TRACE_FRAME_OVERHEAD];
+uint16_t replayLen = 0;
+bool replayPending = false;
+bool replayAnchored = false;
+unsigned long replayOffset = 0;
+unsigned long replayBootMillis = 0;   // Where setup() wrote the HEADER when recording
+bool replayFirstPoll = true;
+
+uint32_t replayRed[TRACE_PPG_MAX];
+uint32_t replayIr[TRACE_PPG_MAX];
+uint8_t replayPpgCount = 0;
+uint32_t replayPpgLost = 0;
+bool replayDhtOk = false;
+bool replayDhtFresh = false;   // A DHT record arrived since halDhtStart()
+int16_t replayHumidity = 0;
+int16_t replayTemperature = 0;
+bool replayHaveRtc = false;
+Time replayRtc;
+bool replayButton = HIGH;
+
+void replayDispatchBlynk(uint8_t pin, int32_t value) {
+  char buf[16];
+  BlynkParam param(buf, 0, sizeof(buf));
+  param.add((long)value);
+  BlynkReq req = { pin };
+  WidgetWriteHandler handler = GetWriteHandler(pin);
+  if (handler) handler(req, param);
 }
 
-BLYNK_WRITE(V_SELECT_MODE) {
-  int receivedValue = param.asInt();
-  
-  Serial.printf("[BLYNK] V_SELECT_MODE received: %d\n", receivedValue);
-  
-  int newMode = receivedValue;
-  
-  if (newMode >= 0 && newMode <= 2) {
-    displayMode = newMode;
-    if (autoModeSwitch) {
-      autoModeSwitch = false;
-      Blynk.virtualWrite(V_AUTO_MODE, 0);
-    }
-    Blynk.virtualWrite(V_TERMINAL, 
-      String("[") + getTimeString() + "] Mode set to: " + 
-      MODE_NAMES[newMode] + "\n");
-    Serial.printf("[MODE] Manual select: Mode %d - %s\n", displayMode + 1, MODE_NAMES[newMode]);
-    showModeChange();
-    forceUpdate = true;
-  } else {
-    Serial.printf("[ERROR] Invalid mode value: %d (must be 0-2)\n", receivedValue);
-    Blynk.virtualWrite(V_TERMINAL, 
-      String("[") + getTimeString() + "] ERROR: Invalid mode value " + 
-      String(receivedValue) + "\n");
+void replayApply() {
+  uint8_t type = replayFrame[1];
+  uint8_t len = replayFrame[2];
+  const uint8_t* p = replayFrame + 7;
+
+  switch (type) {
+    case TRACE_HEADER:
+      // New recording: replayPoll() has re-anchored its clock
+      break;
+
+    case TRACE_PPG:
+      for (uint8_t i = 0; i < p[0] && 1 + i * 6 + 6 <= len; i++) {
+        if (replayPpgCount == TRACE_PPG_MAX) {
+          replayPpgLost++;
+          continue;
+        }
+        replayRed[replayPpgCount] = traceGet24(p + 1 + i * 6);
+        replayIr[replayPpgCount] = traceGet24(p + 4 + i * 6);
+        replayPpgCount++;
+      }
+      break;
+
+    case TRACE_DHT:
+      replayDhtOk = p[0];
+      replayDhtFresh = true;
+      replayHumidity = traceGet16(p + 1);
+      replayTemperature = traceGet16(p + 3);
+      break;
+
+    case TRACE_RTC:
+      replayRtc.year = traceGet16(p);
+      replayRtc.mon = p[2];
+      replayRtc.date = p[3];
+      replayRtc.hour = p[4];
+      replayRtc.min = p[5];
+      replayRtc.sec = p[6];
+      replayRtc.dow = p[7];
+      replayHaveRtc = true;
+      break;
+
+    case TRACE_BUTTON:
+      // Edge times are on the recording's clock; shift them onto ours
+      replayButton = p[0];
+      buttonPushEdge(traceGet32(p + 1) + replayOffset, p[0]);
+      break;
+
+    case TRACE_BLYNK:
+      replayDispatchBlynk(p[0], (int32_t)traceGet32(p + 1));
+      break;
   }
 }
 
-BLYNK_WRITE(V_NEXT_MODE) {
-  int buttonPressed = param.asInt();
-  if (buttonPressed == 1) {
-    displayMode = (displayMode + 1) % 3;
-    if (autoModeSwitch) {
-      autoModeSwitch = false;
-      Blynk.virtualWrite(V_AUTO_MODE, 0);
+// Called from loop(): assembles at most one frame and applies it when due
+void replayPoll() {
+  bool firstPoll = replayFirstPoll;
+  replayFirstPoll = false;
+  while (!replayPending && Serial.available()) {
+    uint8_t b = Serial.read();
+    if (replayLen == 0 && b != TRACE_SYNC) continue;
+    replayFrame[replayLen++] = b;
+
+    if (replayLen == 3 && replayFrame[2] > TRACE_MAX_PAYLOAD) {
+      replayLen = 0;
+      continue;
     }
-    Blynk.virtualWrite(V_SELECT_MODE, displayMode);
-    Blynk.virtualWrite(V_TERMINAL, 
-      String("[") + getTimeString() + "] Mode switched to: " + 
-      MODE_NAMES[displayMode] + "\n");
-    Serial.printf("[MODE] Next mode: %s\n", MODE_NAMES[displayMode]);
-    showModeChange();
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(50);
-    digitalWrite(BUZZER_PIN, LOW);
-    forceUpdate = true;
+    if (replayLen < 3 || replayLen < replayFrame[2] + TRACE_FRAME_OVERHEAD) continue;
+
+    uint8_t crc = traceCrc8(replayFrame + 1, replayLen - 2, 0);
+    if (crc == replayFrame[replayLen - 1]) {
+      replayPending = true;
+    }
+    replayLen = 0;
   }
-}
 
-void updateStatusDisplay() {
-  if (!wifiConnected) return;
-  
-  String status = wifiConnected ? "🟢 Online" : "🔴 Offline";
-  
-  if (alarmRinging) {
-    status = "🔴 ALARM RINGING!";
-  } else if (alarm.enabled) {
-    char buffer[30];
-    sprintf(buffer, "🔔 Alarm: %02d:%02d", alarm.hour, alarm.minute);
-    status = String(buffer);
+  if (!replayPending) return;
+
+  uint32_t frameTime = traceGet32(replayFrame + 3);
+  bool header = replayFrame[1] == TRACE_HEADER;
+  if (header || !replayAnchored) {
+    // A HEADER already waiting on the first pass was sent while we booted,
+    // so the recording started at boot too: line its clock up with ours
+    bool fromBoot = firstPoll && header;
+    replayOffset = (fromBoot ? replayBootMillis : millis()) - frameTime;
+    replayAnchored = true;
   }
-  
-  if (!alarmRinging) {
-    status += String(" | ") + MODE_NAMES[displayMode];
-    if (autoModeSwitch) {
-      status += " (Auto)";
-    }
+  if ((long)(millis() - replayOffset - frameTime) < 0) return;
+
+  replayApply();
+  replayPending = false;
+  replayLen = 0;
+}
+#endif
+
+// ========== HARDWARE ABSTRACTION LAYER ==========
+// All peripheral access goes through these thin wrappers so the rest of
+// the sketch never talks to a driver object directly. Each wrapper bumps
+// a counter in ioStats, which reportPerf() prints together with loop
+// latency so every change can be measured on the bench.
+struct IoStats {
+  uint32_t rtcReads;
+  uint32_t dhtReads;
+  uint32_t dhtErrors;
+  uint32_t ppgBursts;
+  uint32_t ppgSamples;
+  uint32_t ppgOverflows;
+  uint32_t lcdCommands;
+  uint32_t lcdChars;
+  uint32_t lcdI2cBytes;
+  uint32_t eepromWrites;
+  uint32_t eepromCommits;
+  uint32_t blynkWrites;
+  uint32_t blynkFrames;
+  uint32_t blynkSuppressed;
+  uint32_t buzzerWrites;
+};
+
+IoStats ioStats;
+
+void halRtcInit() {
+  rtc.halt(false);
+  rtc.writeProtect(false);
+}
+
+Time halRtcRead() {
+  ioStats.rtcReads++;
+#ifdef TRACE_REPLAY
+  if (replayHaveRtc) return replayRtc;
+#endif
+  Time t = rtc.getTime();
+  traceRtc(t);
+  return t;
+}
+
+// DHT11 decoder. halDhtStart() pulls the line low and returns; loop()
+// keeps calling halDhtPoll(), which releases the line after 20 ms and
+// lets a FALLING-edge interrupt timestamp the sensor's reply:
+//   edge 0       start of the 80 us response pulse
+//   edges 1-40   start of each bit: 50 us low, then high for 27 us (0)
+//                or 70 us (1)
+//   edge 41      end of the last bit
+// Bit i spans edges i+1..i+2, about 77 us for a 0 and 120 us for a 1.
+// The foreground cost is a few pin writes and the decode, instead of the
+// library's ~25 ms busy-wait with interrupts off.
+#define DHT_EDGES 42
+const unsigned long DHT_START_LOW = 20;      // ms, sensor needs >= 18
+const unsigned long DHT_REPLY_TIMEOUT = 10;  // ms, a frame takes ~5
+const uint32_t DHT_BIT_ONE_US = 100;
+
+enum DhtState {
+  DHT_IDLE,
+  DHT_START,
+  DHT_RECEIVING
+};
+
+uint8_t dhtState = DHT_IDLE;
+unsigned long dhtStateSince = 0;
+volatile uint8_t dhtEdgeCount = 0;
+volatile uint32_t dhtEdges[DHT_EDGES];
+
+void IRAM_ATTR dhtEdgeIsr() {
+  uint8_t n = dhtEdgeCount;
+  if (n < DHT_EDGES) {
+    dhtEdges[n] = micros();
+    dhtEdgeCount = n + 1;
   }
-  
-  Blynk.virtualWrite(V_STATUS, status);
 }
 
-void showModeChange() {
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(" MODE CHANGED ");
-  lcd.setCursor(0, 1);
-  String modeName = MODE_NAMES[displayMode];
-  int spaces = (16 - modeName.length()) / 2;
-  for (int i = 0; i < spaces; i++) lcd.print(" ");
-  lcd.print(modeName);
-  delay(1000);
-  lcd.clear();
+void halDhtInit() {
+  pinMode(DHT_PIN, INPUT_PULLUP);
 }
 
-// ========== SEND DATA TO BLYNK ==========
-void sendDataToBlynk() {
-  if (!wifiConnected) return;
-  
-  Blynk.virtualWrite(V_TIME, getTimeString());
-  Blynk.virtualWrite(V_DATE, getDateString());
-  Blynk.virtualWrite(V_TEMP, temperature);
-  Blynk.virtualWrite(V_HUMIDITY, humidity);
-  Blynk.virtualWrite(V_HEARTRATE, fingerDetected ? heartRate : 0);
-  updateStatusDisplay();
+// Starts a conversion unless one is already running
+void halDhtStart() {
+  if (dhtState != DHT_IDLE) return;
+  ioStats.dhtReads++;
+#ifdef TRACE_REPLAY
+  replayDhtFresh = false;
+#else
+  pinMode(DHT_PIN, OUTPUT);
+  digitalWrite(DHT_PIN, LOW);
+#endif
+  dhtState = DHT_START;
+  dhtStateSince = millis();
 }
 
-// ========== UPDATE LCD DISPLAY ==========
-void updateDisplay() {
-  if (autoModeSwitch && (millis() - lastModeSwitch >= MODE_INTERVAL)) {
-    lastModeSwitch = millis();
-    displayMode = (displayMode + 1) % 3;
-    forceUpdate = true;
-    
-    if (wifiConnected) {
-      Blynk.virtualWrite(V_SELECT_MODE, displayMode);
-    }
-    
-    Serial.printf("[AUTO] Mode changed to: %d - %s\n", displayMode + 1, MODE_NAMES[displayMode]);
+void dhtFinish() {
+  detachInterrupt(digitalPinToInterrupt(DHT_PIN));
+  dhtState = DHT_IDLE;
+}
+
+// Advances the conversion; true once a checksummed result is in h/t,
+// both in 0.1 units
+bool halDhtPoll(int16_t &h, int16_t &t) {
+#ifdef TRACE_REPLAY
+  // The conversion ends when the recording's result does, so readings
+  // land on the same timer tick as they did live. Every live read left a
+  // record, failed or not; only one the trace lost times out here.
+  if (dhtState == DHT_IDLE) return false;
+  if (!replayDhtFresh) {
+    if (millis() - dhtStateSince < 2 * (DHT_START_LOW + DHT_REPLY_TIMEOUT)) return false;
+    dhtState = DHT_IDLE;
+    ioStats.dhtErrors++;
+    return false;
   }
-  
-  static int lastDisplayedMode = -1;
-  static unsigned long lastLCDUpdate = 0;
-  
-  if (forceUpdate || lastDisplayedMode != displayMode || (millis() - lastLCDUpdate > 500)) {
-    lastDisplayedMode = displayMode;
-    lastLCDUpdate = millis();
-    forceUpdate = false;
-    
-    lcd.clear();
-    Time t = rtc.getTime();
-    
-    lcd.setCursor(14, 0);
-    if (!wifiConnected) {
-      lcd.print("O");
-    }
-    lcd.setCursor(15, 0);
-    lcd.print(displayMode + 1);
-    
-    switch(displayMode) {
-      case 0:
-        lcd.setCursor(0, 0);
-        if (t.hour < 10) lcd.print("0");
-        lcd.print(t.hour);
-        lcd.print(":");
-        if (t.min < 10) lcd.print("0");
-        lcd.print(t.min);
-        lcd.print(":");
-        if (t.sec < 10) lcd.print("0");
-        lcd.print(t.sec);
-        
-        if (alarm.enabled) {
-          lcd.setCursor(9, 0);
-          lcd.print("A");
-          lcd.setCursor(10, 0);
-          lcd.printf("%02d:%02d", alarm.hour, alarm.minute);
-        }
-        
-        lcd.setCursor(0, 1);
-        lcd.printf("T:%.1fC H:%d%%", temperature, (int)humidity);
-        break;
-        
-      case 1:
-        lcd.setCursor(0, 0);
-        lcd.print("IR:");
-        lcd.print(irValue / 1000);
-        lcd.print("k");
-        
-        if (alarmMuted) {
-          lcd.setCursor(10, 0);
-          lcd.print("[M]");
-        }
-        
-        lcd.setCursor(0, 1);
-        lcd.print("BPM:");
-        
-        if (irValue > 50000 && irValue < 200000) {
-          if (heartRate > 0) {
-            lcd.print(heartRate);
-            lcd.print(" ");
-            
-            if (heartRate >= HR_HIGH || heartRate <= HR_LOW) {
-              lcd.print("HIGH!");
-            } else {
-              lcd.print("OK");
-            }
-            
-            if ((millis() / 500) % 2 == 0) {
-              lcd.setCursor(13, 1);
-              lcd.print("*");
-            }
-          } else {
-            lcd.print("Wait...");
-          }
-        } else if (irValue >= 200000) {
-          lcd.print("OVERLOAD!");
-        } else {
-          lcd.print("--");
-        }
-        break;
-        
-      case 2:
-        lcd.setCursor(0, 0);
-        if (t.date < 10) lcd.print("0");
-        lcd.print(t.date);
-        lcd.print("/");
-        if (t.mon < 10) lcd.print("0");
-        lcd.print(t.mon);
-        lcd.print("/");
-        lcd.print(t.year);
-        
-        lcd.setCursor(0, 1);
-        lcd.printf("%.1fC %d%% %dBPM", temperature, (int)humidity, heartRate);
-        break;
-    }
+  dhtState = DHT_IDLE;
+  h = replayHumidity;
+  t = replayTemperature;
+  return replayDhtOk;
+#endif
+
+  if (dhtState == DHT_START) {
+    if (millis() - dhtStateSince < DHT_START_LOW) return false;
+    // Arm first: the sensor answers 20-40 us after the line goes high
+    dhtEdgeCount = 0;
+    attachInterrupt(digitalPinToInterrupt(DHT_PIN), dhtEdgeIsr, FALLING);
+    pinMode(DHT_PIN, INPUT_PULLUP);
+    dhtState = DHT_RECEIVING;
+    dhtStateSince = millis();
+    return false;
   }
-}
 
-// ========== PHYSICAL BUTTON HANDLER ==========
-void handlePhysicalButton() {
-  static unsigned long buttonPressTime = 0;
-  static bool buttonWasPressed = false;
-  
-  bool reading = digitalRead(BUTTON_PIN);
-  
-  if (reading != lastButtonState) {
-    lastDebounceTime = millis();
+  if (dhtState != DHT_RECEIVING) return false;
+
+  if (dhtEdgeCount < DHT_EDGES) {
+    if (millis() - dhtStateSince < DHT_REPLY_TIMEOUT) return false;
+    dhtFinish();
+    ioStats.dhtErrors++;
+    traceDht(false, 0, 0);
+    return false;
   }
-  
-  if ((millis() - lastDebounceTime) > DEBOUNCE_DELAY) {
-    if (reading != buttonState) {
-      buttonState = reading;
-      
-      // Button PRESSED
-      if (buttonState == LOW) {
-        buttonPressTime = millis();
-        buttonWasPressed = true;
-      }
-      // Button RELEASED
-      else if (buttonWasPressed) {
-        buttonWasPressed = false;
-        unsigned long pressDuration = millis() - buttonPressTime;
-        
-        if (alarmRinging) {
-          stopAlarmSound("Physical Button");
-        } else {
-          // SHORT PRESS: Switch Mode
-          if (pressDuration < 1000) {
-            displayMode = (displayMode + 1) % 3;
-            
-            if (autoModeSwitch) {
-              autoModeSwitch = false;
-              if (wifiConnected) {
-                Blynk.virtualWrite(V_AUTO_MODE, 0);
-                Blynk.virtualWrite(V_SELECT_MODE, displayMode);
-              }
-            }
-            
-            Serial.printf("[BUTTON] Short press - Mode switched to: %d - %s\n", displayMode + 1, MODE_NAMES[displayMode]);
-            showModeChange();
-            
-            digitalWrite(BUZZER_PIN, HIGH);
-            delay(50);
-            digitalWrite(BUZZER_PIN, LOW);
-            forceUpdate = true;
-          }
-          // LONG PRESS (≥1s): Toggle Mute (only in Mode 2)
-          else {
-            if (displayMode == 1) {
-              alarmMuted = !alarmMuted;
-              
-              lcd.clear();
-              lcd.setCursor(0, 0);
-              lcd.print("Alarm Warning:");
-              lcd.setCursor(0, 1);
-              lcd.print(alarmMuted ? "MUTED" : "UNMUTED");
-              
-              Serial.print("[BUTTON] Long press - Alarm ");
-              Serial.println(alarmMuted ? "MUTED" : "UNMUTED");
-              
-              // Beep pattern: 2 short beeps for mute, 1 long for unmute
-              if (alarmMuted) {
-                digitalWrite(BUZZER_PIN, HIGH);
-                delay(100);
-                digitalWrite(BUZZER_PIN, LOW);
-                delay(100);
-                digitalWrite(BUZZER_PIN, HIGH);
-                delay(100);
-                digitalWrite(BUZZER_PIN, LOW);
-              } else {
-                digitalWrite(BUZZER_PIN, HIGH);
-                delay(300);
-                digitalWrite(BUZZER_PIN, LOW);
-              }
-              
-              delay(1500);
-              forceUpdate = true;
-            } else {
-              // Long press in other modes - show info
-              lcd.clear();
-              lcd.setCursor(0, 0);
-              lcd.print("Long press:");
-              lcd.setCursor(0, 1);
-              lcd.print("Mode 2 only");
-              delay(1000);
-              forceUpdate = true;
-            }
-          }
-        }
-      }
-    }
+  dhtFinish();
+
+  uint8_t data[5] = {0, 0, 0, 0, 0};
+  for (uint8_t i = 0; i < 40; i++) {
+    uint32_t width = dhtEdges[i + 2] - dhtEdges[i + 1];
+    data[i / 8] = (data[i / 8] << 1) | (width > DHT_BIT_ONE_US);
   }
-  
-  lastButtonState = reading;
+
+  if ((uint8_t)(data[0] + data[1] + data[2] + data[3]) != data[4]) {
+    ioStats.dhtErrors++;
+    traceDht(false, 0, 0);
+    return false;
+  }
+
+  h = data[0] * 10 + data[1];
+  t = data[2] * 10 + (data[3] & 0x7F);
+  if (data[3] & 0x80) t = -t;   // Newer DHT11 parts report below zero
+  traceDht(true, h, t);
+  return true;
 }
 
-// ========== ALARM CONTROL ==========
-void checkAlarm() {
-  if (!alarm.enabled) {
-    if (alarmRinging) stopAlarmSound("Auto");
-    return;
+// MAX30102 FIFO registers. The library only hands out one sample per
+// call, so the FIFO is drained here with a single pointer write followed
+// by bulk reads.
+#define MAX30102_REG_OVF_COUNTER  0x05
+#define MAX30102_REG_FIFO_DATA    0x07
+#define MAX30102_FIFO_DEPTH       32
+#define MAX30102_SAMPLE_BYTES     6     // Red + IR, 3 bytes each
+
+bool halIrInit() {
+#ifdef TRACE_REPLAY
+  return true;
+#endif
+  if (!particleSensor.begin(Wire, I2C_CLOCK)) return false;
+  // Red + IR only, 400 Hz with 4-sample averaging = 100 samples/s
+  particleSensor.setup(0x1F, 4, 2, 400, 411, 4096);
+  particleSensor.setPulseAmplitudeRed(0x0A);
+#ifdef PPG_INT_PIN
+  pinMode(PPG_INT_PIN, INPUT_PULLUP);
+  particleSensor.setFIFOAlmostFull(0x0F);  // INT at 17 unread samples
+  particleSensor.enableAFULL();
+#endif
+  particleSensor.clearFIFO();
+  return true;
+}
+
+// True when the sensor signals FIFO almost full (always false without INT).
+// In a replay each recorded burst is drained as soon as it is applied.
+bool halPpgInterrupt() {
+#ifdef TRACE_REPLAY
+  return replayPpgCount > 0;
+#elif defined(PPG_INT_PIN)
+  return digitalRead(PPG_INT_PIN) == LOW;
+#else
+  return false;
+#endif
+}
+
+// Reads every unread FIFO sample (up to maxSamples), oldest first.
+// Returns the number of samples stored in red[]/ir[].
+uint8_t halPpgReadFifo(uint32_t* red, uint32_t* ir, uint8_t maxSamples) {
+  ioStats.ppgBursts++;
+
+#ifdef TRACE_REPLAY
+  uint8_t n = replayPpgCount < maxSamples ? replayPpgCount : maxSamples;
+  memcpy(red, replayRed, n * sizeof(uint32_t));
+  memcpy(ir, replayIr, n * sizeof(uint32_t));
+  memmove(replayRed, replayRed + n, (replayPpgCount - n) * sizeof(uint32_t));
+  memmove(replayIr, replayIr + n, (replayPpgCount - n) * sizeof(uint32_t));
+  replayPpgCount -= n;
+  ioStats.ppgOverflows += replayPpgLost;
+  replayPpgLost = 0;
+  ioStats.ppgSamples += n;
+  return n;
+#endif
+
+  uint8_t readPtr = particleSensor.getReadPointer();
+  uint8_t writePtr = particleSensor.getWritePointer();
+  uint8_t count = (writePtr - readPtr) & (MAX30102_FIFO_DEPTH - 1);
+
+  // Equal pointers mean either empty or full-and-rolled-over
+  if (count == 0) {
+    uint8_t lost = particleSensor.readRegister8(MAX30105_ADDRESS, MAX30102_REG_OVF_COUNTER);
+    if (lost == 0) return 0;
+    ioStats.ppgOverflows += lost;
+    count = MAX30102_FIFO_DEPTH;
   }
-  
-  Time t = rtc.getTime();
-  
-  if (t.hour == alarm.hour && 
-      t.min == alarm.minute && 
-      t.sec == 0 && 
-      !alarmRinging) {
-    
-    alarmRinging = true;
-    alarmStartTime = millis();
-    
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("*** ALARM! ***");
-    lcd.setCursor(0, 1);
-    lcd.printf("Press button!");
-    
-    if (wifiConnected) {
-      Blynk.virtualWrite(V_TERMINAL, 
-        String("[") + getTimeString() + "] ⏰ ALARM RINGING!\n");
-      
-      Blynk.logEvent("alarm_event", String("Alarm at ") + 
-        String(alarm.hour) + ":" + String(alarm.minute));
-      
-      updateStatusDisplay();
+  if (count > maxSamples) count = maxSamples;
+
+  Wire.beginTransmission(MAX30105_ADDRESS);
+  Wire.write(MAX30102_REG_FIFO_DATA);
+  Wire.endTransmission();
+
+  uint8_t done = 0;
+  while (done < count) {
+    uint8_t chunk = count - done;
+    if (chunk > BUFFER_LENGTH / MAX30102_SAMPLE_BYTES) {
+      chunk = BUFFER_LENGTH / MAX30102_SAMPLE_BYTES;
     }
-    
-    Serial.println("[ALARM] ⏰ TRIGGERED!");
-  }
-  
-  if (alarmRinging) {
-    playAlarmSound();
-    
-    if (millis() - alarmStartTime > ALARM_DURATION) {
-      stopAlarmSound("Timeout");
+    Wire.requestFrom((uint8_t)MAX30105_ADDRESS, (uint8_t)(chunk * MAX30102_SAMPLE_BYTES));
+
+    for (uint8_t i = 0; i < chunk; i++, done++) {
+      uint32_t r = (uint32_t)Wire.read() << 16;
+      r |= (uint32_t)Wire.read() << 8;
+      r |= Wire.read();
+      uint32_t v = (uint32_t)Wire.read() << 16;
+      v |= (uint32_t)Wire.read() << 8;
+      v |= Wire.read();
+      red[done] = r & 0x3FFFF;
+      ir[done] = v & 0x3FFFF;
     }
   }
+
+#ifdef PPG_INT_PIN
+  particleSensor.getINT1();  // Reading the status register releases INT
+#endif
+
+  tracePpg(red, ir, count);
+  ioStats.ppgSamples += count;
+  return count;
 }
 
-void playAlarmSound() {
-  if (millis() - lastBuzzerToggle > (buzzerState ? 1000 : 500)) {
-    lastBuzzerToggle = millis();
-    buzzerState = !buzzerState;
-    digitalWrite(BUZZER_PIN, buzzerState ? HIGH : LOW);
+// Button edges are timestamped by a CHANGE interrupt and queued in a
+// single-producer/single-consumer ring: only the ISR advances the head
+// and only loop() advances the tail, each after its slot is complete, so
+// neither side has to mask interrupts. Bounces are queued too; the
+// gesture recognizer filters them using the timestamps.
+#define BUTTON_EDGE_RING 16   // Power of two
+
+volatile uint32_t buttonEdgeTimes[BUTTON_EDGE_RING];
+volatile bool buttonEdgeLevels[BUTTON_EDGE_RING];
+volatile uint8_t buttonEdgeHead = 0;
+volatile uint8_t buttonEdgeTail = 0;
+volatile uint32_t buttonEdgeOverflows = 0;
+
+void IRAM_ATTR buttonPushEdge(uint32_t time, bool level) {
+  uint8_t head = buttonEdgeHead;
+  uint8_t next = (head + 1) & (BUTTON_EDGE_RING - 1);
+  if (next == buttonEdgeTail) {
+    buttonEdgeOverflows++;
+    return;
   }
+  buttonEdgeTimes[head] = time;
+  buttonEdgeLevels[head] = level;
+  buttonEdgeHead = next;
 }
 
-void stopAlarmSound(String source) {
-  alarmRinging = false;
-  digitalWrite(BUZZER_PIN, LOW);
-  buzzerState = false;
-  
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("Alarm Stopped");
-  lcd.setCursor(0, 1);
-  lcd.print("by " + source);
-  delay(2000);
-  
-  if (wifiConnected) {
-    Blynk.virtualWrite(V_TERMINAL, 
-      String("[") + getTimeString() + "] Alarm stopped by " + source + "\n");
-    updateStatusDisplay();
-  }
+void IRAM_ATTR buttonEdgeIsr() {
+  buttonPushEdge(millis(), digitalRead(BUTTON_PIN));
+}
+
+void halButtonInit() {
+  pinMode(BUTTON_PIN, INPUT_PULLUP);
+#ifndef TRACE_REPLAY
+  attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), buttonEdgeIsr, CHANGE);
+#endif
+}
+
+// Pops the oldest queued edge; false when there is none
+bool halButtonNextEdge(uint32_t &time, bool &level) {
+  uint8_t tail = buttonEdgeTail;
+  if (tail == buttonEdgeHead) return false;
+  time = buttonEdgeTimes[tail];
+  level = buttonEdgeLevels[tail];
+  buttonEdgeTail = (tail + 1) & (BUTTON_EDGE_RING - 1);
+  traceButton(level, time);
+  return true;
+}
+
+bool halButtonRead() {
+#ifdef TRACE_REPLAY
+  return replayButton;
+#endif
+  return digitalRead(BUTTON_PIN);
+}
+
+void halBuzzer(bool on) {
+  ioStats.buzzerWrites++;
+  digitalWrite(BUZZER_PIN, on ? HIGH : LOW);
+}
+
+#define EEPROM_SIZE 512
+
+void halEepromBegin() {
+  EEPROM.begin(EEPROM_SIZE);
+}
+
+uint8_t halEepromRead(int addr) {
+  return EEPROM.read(addr);
+}
+
+void halEepromWrite(int addr, uint8_t value) {
+  ioStats.eepromWrites++;
+  EEPROM.write(addr, value);
+}
+
+void halEepromCommit() {
+  ioStats.eepromCommits++;
+  EEPROM.commit();
+}
+
+// A Blynk group gives the writes inside it one timestamp; it does not
+// merge them. Every write is still its own frame, and beginGroup() and
+// endGroup() send one each, so a group of N writes costs N + 2 frames.
+// Only the offline backlog uses groups, to keep its original timestamps.
+
+void countBlynkWrite() {
+  ioStats.blynkWrites++;
+  ioStats.blynkFrames++;
+}
+
+// Group stamped with a past time (Unix ms) instead of the arrival time
+void halBlynkBeginGroup(uint64_t timestampMs) {
+  Blynk.beginGroup(timestampMs);
+  ioStats.blynkFrames++;
+}
+
+void halBlynkEndGroup() {
+  Blynk.endGroup();
+  ioStats.blynkFrames++;
+}
+
+void halBlynkWrite(int pin, const char* value) {
+  countBlynkWrite();
+  Blynk.virtualWrite(pin, value);
+}
+
+void halBlynkWrite(int pin, int value) {
+  countBlynkWrite();
+  Blynk.virtualWrite(pin, value);
+}
+
+void halBlynkLogEvent(const char* event, const char* msg) {
+  countBlynkWrite();
+  Blynk.logEvent(event, msg);
+}
+
+// LCD front end: same Print interface as LiquidCrystal_I2C, so the
+// existing lcd.print()/lcd.printf() calls keep working unchanged.
+// Drawing only touches a 16x2 shadow frame in RAM; flush() compares it
+// with what the panel currently shows and sends just the changed runs,
+// so clear() + full redraw no longer costs any bus traffic by itself.
+#define LCD_COLS 16
+#define LCD_ROWS 2
+
+// LiquidCrystal_I2C sends every byte as two nibbles, each written to the
+// PCF8574 three times (data, EN high, EN low), each write being address
+// plus one data byte on the bus
+const uint8_t LCD_I2C_BYTES_PER_TRANSFER = 12;
+
+// The batched backend talks to the PCF8574 directly and packs a whole
+// run (cursor command plus characters) into one Wire transaction. The
+// expander latches every byte it receives, so each nibble goes out as
+// two bytes, EN high then EN low: 4 bytes per character plus one address
+// byte per transaction. Backpack wiring: P0=RS, P1=RW, P2=EN,
+// P3=backlight, P4-P7=D4-D7. A character takes ~360 us on the bus at
+// 100 kHz (~90 us with I2C_FAST), longer than the controller's 37 us
+// execution time, so no extra waits are needed.
+//
+// init() does the datasheet's 4-bit power-up sequence the same way, with
+// only the waits the controller needs (~46 ms from power-on in all).
+// LiquidCrystal_I2C::init() spends over a second in delay(), so the
+// library is only initialised when its backend is first selected.
+#define LCD_RS        0x01
+#define LCD_EN        0x04
+#define LCD_BACKLIGHT 0x08
+#define LCD_CMD_CLEAR 0x01
+#define LCD_CMD_ENTRY 0x06    // Increment, no shift
+#define LCD_CMD_ON    0x0C    // Display on, cursor off
+#define LCD_CMD_4BIT  0x28    // 4-bit bus, 2 lines, 5x8 font
+#define LCD_CMD_CGRAM 0x40
+#define LCD_CMD_DDRAM 0x80
+const uint8_t LCD_ROW_OFFSETS[LCD_ROWS] = {0x00, 0x40};
+const unsigned long LCD_POWER_ON_MS = 40;
+const unsigned int LCD_CLEAR_US = 1520;
+
+class HalLcd : public Print {
+public:
+  void init() {
+    unsigned long sincePowerOn = millis();
+    if (sincePowerOn < LCD_POWER_ON_MS) delay(LCD_POWER_ON_MS - sincePowerOn);
+
+    // Still in 8-bit mode: each nibble is a whole instruction
+    initNibble(0x30);
+    delayMicroseconds(4100);
+    initNibble(0x30);
+    delayMicroseconds(100);
+    initNibble(0x30);
+    initNibble(0x20);
+
+    beginBatch();
+    batchByte(LCD_CMD_4BIT, 0);
+    batchByte(LCD_CMD_ON, 0);
+    batchByte(LCD_CMD_CLEAR, 0);
+    endBatch();
+    delayMicroseconds(LCD_CLEAR_US);
+    beginBatch();
+    batchByte(LCD_CMD_ENTRY, 0);
+    endBatch();
+
+    memset(frame, ' ', sizeof(frame));
+    memset(shown, ' ', sizeof(shown));
+    driverCol = 0xFF;
+    glyphsLoaded = 0;
+  }
+
+  void backlight() {
+    lcdDriver.backlight();
+    backlightBit = LCD_BACKLIGHT;
+  }
+
+  // true: batched transactions, false: through LiquidCrystal_I2C
+  void setBatched(bool on) {
+    if (!on && !driverReady) {
+      // The library's init clears the panel, so everything is redrawn
+      lcdDriver.init();
+      driverReady = true;
+      for (uint8_t r = 0; r < LCD_ROWS; r++) invalidate(r, 0, LCD_COLS);
+      driverCol = 0xFF;
+    }
+    batched = on;
+  }
+
+  // Marks cells as unknown so the next flush() rewrites them
+  void invalidate(uint8_t r, uint8_t c, uint8_t count) {
+    for (uint8_t i = c; i < c + count && i < LCD_COLS; i++) {
+      shown[r][i] = ~frame[r][i];
+    }
+  }
+
+  void clear() {
+    memset(frame, ' ', sizeof(frame));
+    col = 0;
+    row = 0;
+  }
+
+  void setCursor(uint8_t c, uint8_t r) {
+    col = c;
+    row = r;
+  }
+
+  size_t write(uint8_t c) override {
+    if (row < LCD_ROWS && col < LCD_COLS) {
+      frame[row][col] = c;
+    }
+    col++;
+    return 1;
+  }
+
+  using Print::write;
+
+  // Loads custom character slot (0-7) only when its bitmap changed; the
+  // panel redraws every cell using the slot by itself. Writing CGRAM
+  // moves the controller's address, so the next run re-sends its cursor.
+  void createChar(uint8_t slot, const uint8_t* bitmap) {
+    if ((glyphsLoaded & (1 << slot)) && memcmp(glyphs[slot], bitmap, 8) == 0) return;
+    memcpy(glyphs[slot], bitmap, 8);
+    glyphsLoaded |= 1 << slot;
+
+    if (batched) {
+      beginBatch();
+      batchByte(LCD_CMD_CGRAM | (slot << 3), 0);
+      for (uint8_t i = 0; i < 8; i++) batchByte(glyphs[slot][i], LCD_RS);
+      endBatch();
+    } else {
+      sendCommand();
+      for (uint8_t i = 0; i < 8; i++) sendChar();
+      lcdDriver.createChar(slot, glyphs[slot]);
+    }
+    driverCol = 0xFF;
+  }
+
+  // Sends the cells that differ from the panel. Runs separated by a
+  // single unchanged cell are merged: rewriting one cell costs the same
+  // as the setCursor it replaces.
+  void flush() {
+    for (uint8_t r = 0; r < LCD_ROWS; r++) {
+      uint8_t c = 0;
+      while (c < LCD_COLS) {
+        if (frame[r][c] == shown[r][c]) {
+          c++;
+          continue;
+        }
+
+        uint8_t end = c + 1;
+        while (end < LCD_COLS) {
+          if (frame[r][end] != shown[r][end]) {
+            end++;
+          } else if (end + 1 < LCD_COLS && frame[r][end + 1] != shown[r][end + 1]) {
+            end += 2;
+          } else {
+            break;
+          }
+        }
+
+        bool moveCursor = driverRow != r || driverCol != c;
+        if (batched) {
+          beginBatch();
+          if (moveCursor) batchByte(LCD_CMD_DDRAM | (LCD_ROW_OFFSETS[r] + c), 0);
+          for (uint8_t i = c; i < end; i++) {
+            batchByte(frame[r][i], LCD_RS);
+            shown[r][i] = frame[r][i];
+          }
+          endBatch();
+        } else {
+          if (moveCursor) {
+            sendCommand();
+            lcdDriver.setCursor(c, r);
+          }
+          for (uint8_t i = c; i < end; i++) {
+            sendChar();
+            lcdDriver.write(frame[r][i]);
+            shown[r][i] = frame[r][i];
+          }
+        }
+
+        driverRow = r;
+        driverCol = end < LCD_COLS ? end : 0xFF;  // Past the edge: unknown
+        c = end;
+      }
+    }
+  }
+
+private:
+  uint8_t frame[LCD_ROWS][LCD_COLS];
+  uint8_t shown[LCD_ROWS][LCD_COLS];
+  uint8_t col = 0;
+  uint8_t row = 0;
+  uint8_t driverCol = 0xFF;
+  uint8_t driverRow = 0;
+  uint8_t glyphs[8][8];
+  uint8_t glyphsLoaded = 0;    // Bit per slot whose bitmap is known
+  bool batched = true;
+  bool driverReady = false;    // LiquidCrystal_I2C initialised
+  uint8_t backlightBit = 0;
+  uint8_t batchLength = 0;     // Bytes queued in the open transaction
+
+  void beginBatch() {
+    Wire.beginTransmission(LCD_I2C_ADDR);
+    batchLength = 0;
+    ioStats.lcdI2cBytes++;     // Address byte
+  }
+
+  void endBatch() {
+    Wire.endTransmission();
+  }
+
+  void initNibble(uint8_t bits) {
+    beginBatch();
+    batchNibble(bits);
+    ioStats.lcdI2cBytes += 2;
+    ioStats.lcdCommands++;
+    endBatch();
+  }
+
+  void batchNibble(uint8_t bits) {
+    bits |= backlightBit;
+    Wire.write(bits | LCD_EN);
+    Wire.write(bits);
+  }
+
+  // RS is 0 for a command, LCD_RS for character data
+  void batchByte(uint8_t value, uint8_t rs) {
+    if (batchLength + 4 > BUFFER_LENGTH) {
+      endBatch();
+      beginBatch();
+    }
+    batchNibble((value & 0xF0) | rs);
+    batchNibble((value << 4) | rs);
+    batchLength += 4;
+    ioStats.lcdI2cBytes += 4;
+    if (rs) {
+      ioStats.lcdChars++;
+    } else {
+      ioStats.lcdCommands++;
+    }
+  }
+
+  void sendCommand() {
+    ioStats.lcdCommands++;
+    ioStats.lcdI2cBytes += LCD_I2C_BYTES_PER_TRANSFER;
+  }
+
+  void sendChar() {
+    ioStats.lcdChars++;
+    ioStats.lcdI2cBytes += LCD_I2C_BYTES_PER_TRANSFER;
+  }
+};
+
+HalLcd lcd;
+
+// Times flush() for a full-screen and a single-cell update with both
+// backends. The panel ends up showing the same frame as before.
+void benchLcd() {
+  const uint8_t RUNS = 20;
+  for (uint8_t mode = 0; mode < 2; mode++) {
+    lcd.setBatched(mode == 1);
+    const char* name = mode ? "batched" : "library";
+
+    uint32_t bytesBefore = ioStats.lcdI2cBytes;
+    uint32_t start = micros();
+    for (uint8_t i = 0; i < RUNS; i++) {
+      for (uint8_t r = 0; r < LCD_ROWS; r++) lcd.invalidate(r, 0, LCD_COLS);
+      lcd.flush();
+    }
+    uint32_t fullUs = (micros() - start) / RUNS;
+    uint32_t fullBytes = (ioStats.lcdI2cBytes - bytesBefore) / RUNS;
+
+    bytesBefore = ioStats.lcdI2cBytes;
+    start = micros();
+    for (uint8_t i = 0; i < RUNS; i++) {
+      lcd.invalidate(1, i % LCD_COLS, 1);
+      lcd.flush();
+    }
+    uint32_t cellUs = (micros() - start) / RUNS;
+    uint32_t cellBytes = (ioStats.lcdI2cBytes - bytesBefore) / RUNS;
+
+    Serial.printf("[LCD] %-7s full screen %5uus %4uB, one cell %4uus %3uB (%ukHz)\n",
+      name, fullUs, fullBytes, cellUs, cellBytes, I2C_CLOCK / 1000);
+  }
+  lcd.setBatched(true);
+}
+
+// ========== PERFORMANCE REPORT ==========
+const unsigned long PERF_REPORT_INTERVAL = 10000;
+
+unsigned long perfWindowStart = 0;
+uint32_t perfLoopCount = 0;
+uint32_t perfLoopTotalUs = 0;
+uint32_t perfLoopMaxUs = 0;
+uint32_t perfLoopWorstUs = 0;  // since boot, never reset
+uint32_t perfPpgCycles = 0;
+uint32_t perfPpgSamples = 0;
+uint32_t perfRenderCycles = 0;      // Formatting LCD fields, no I2C
+uint32_t perfRenderFields = 0;
+uint32_t perfHeapMin = 0xFFFFFFFF;  // Lowest free heap seen since boot
+
+void recordLoopTime(uint32_t elapsedUs) {
+  perfLoopCount++;
+  perfLoopTotalUs += elapsedUs;
+  if (elapsedUs > perfLoopMaxUs) perfLoopMaxUs = elapsedUs;
+  if (elapsedUs > perfLoopWorstUs) perfLoopWorstUs = elapsedUs;
+}
+
+void reportPerf() {
+  // Rates use the window's real length: a slow loop() pass reports late
+  unsigned long now = millis();
+  unsigned long windowMs = now - perfWindowStart;
+  if (windowMs < PERF_REPORT_INTERVAL) return;
+  perfWindowStart = now;
+
+  Serial.printf("[PERF] loops=%u avg=%uus max=%uus worst=%uus\n",
+    perfLoopCount, perfLoopCount ? perfLoopTotalUs / perfLoopCount : 0,
+    perfLoopMaxUs, perfLoopWorstUs);
+  Serial.printf("[PERF] ppg %u samples, %u cycles/sample, %u dropped, hr %d (conf %d%%)\n",
+    perfPpgSamples, perfPpgSamples ? perfPpgCycles / perfPpgSamples : 0, ppgDropped,
+    heartRate, hrConfidence);
+  Serial.printf("[PERF] display %u fields, %u cycles/field\n",
+    perfRenderFields, perfRenderFields ? perfRenderCycles / perfRenderFields : 0);
+  Serial.printf("[PERF] io rtc=%u dht=%u(err %u) ppg=%u/%u(ovf %u) lcd=%ucmd/%uch(%uB/s) eeprom=%uw/%uc blynk=%uw/%uf(-%u) buzzer=%u button(ovf %u)\n",
+    ioStats.rtcReads, ioStats.dhtReads, ioStats.dhtErrors,
+    ioStats.ppgBursts, ioStats.ppgSamples, ioStats.ppgOverflows,
+    ioStats.lcdCommands, ioStats.lcdChars,
+    (unsigned)(ioStats.lcdI2cBytes * 1000UL / windowMs),
+    ioStats.eepromWrites, ioStats.eepromCommits,
+    ioStats.blynkWrites, ioStats.blynkFrames, ioStats.blynkSuppressed,
+    ioStats.buzzerWrites, buttonEdgeOverflows);
+
+  uint32_t heapFree = ESP.getFreeHeap();
+  if (heapFree < perfHeapMin) perfHeapMin = heapFree;
+  Serial.printf("[PERF] heap free=%u min=%u maxblock=%u frag=%u%%\n",
+    heapFree, perfHeapMin, ESP.getMaxFreeBlockSize(), ESP.getHeapFragmentation());
+  printNetStats();
+  printStoreStats();
+  printRuleStats();
+
+  perfLoopCount = 0;
+  perfLoopTotalUs = 0;
+  perfLoopMaxUs = 0;
+  perfPpgCycles = 0;
+  perfPpgSamples = 0;
+  perfRenderCycles = 0;
+  perfRenderFields = 0;
+  memset(&ioStats, 0, sizeof(ioStats));
+}
+
+// ========== STAGE PROFILER ==========
+// loop() stamps the cycle counter between stages; profileStage() charges
+// the elapsed time to one stage. Each stage keeps exact min/max/mean plus
+// a log2 histogram of microseconds (bucket i holds [2^i, 2^(i+1)) us),
+// which is enough for a p99 estimate without storing samples. A stage
+// that runs longer than profileStallUs is logged in a small stall ring.
+enum ProfileStage {
+  STAGE_CLOCK,
+  STAGE_BLYNK,
+  STAGE_TIMER,
+  STAGE_WIFI,
+  STAGE_SENSORS,
+  STAGE_HEART,
+  STAGE_ALARM,
+  STAGE_HEALTH,
+  STAGE_BUTTON,
+  STAGE_BUZZER,
+  STAGE_DISPLAY,
+  STAGE_TERMINAL,
+  STAGE_CONFIG,
+  STAGE_STORE,
+  STAGE_COUNT
+};
+
+const char* STAGE_NAMES[STAGE_COUNT] = {
+  "clock", "blynk", "timer", "wifi", "sensors", "heart", "alarm",
+  "health", "button", "buzzer", "display", "terminal", "config", "store"
+};
+
+const uint8_t PROFILE_BUCKETS = 18;     // Last bucket: 131 ms and up
+const uint8_t PROFILE_STALL_LOG = 8;
+
+struct StageProfile {
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t totalUs;
+  uint32_t buckets[PROFILE_BUCKETS];
+};
+
+struct StallRecord {
+  unsigned long time;   // millis() when the stage finished
+  uint8_t stage;
+  uint32_t us;
+};
+
+StageProfile stageProfiles[STAGE_COUNT];
+StallRecord stallLog[PROFILE_STALL_LOG];
+uint8_t stallNext = 0;
+uint32_t stallCount = 0;
+uint32_t profileStallUs = 50000;
+uint32_t profileLoops = 0;
+unsigned long profileStart = 0;
+uint32_t profileCyclesPerUs = 80;
+
+void resetProfile() {
+  memset(stageProfiles, 0, sizeof(stageProfiles));
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    stageProfiles[i].minUs = 0xFFFFFFFF;
+  }
+  stallNext = 0;
+  stallCount = 0;
+  profileLoops = 0;
+  profileStart = millis();
+  profileCyclesPerUs = ESP.getCpuFreqMHz();
+}
+
+// Charges the cycles since mark to stage and returns the new mark
+uint32_t profileStage(uint8_t stage, uint32_t mark) {
+  uint32_t now = ESP.getCycleCount();
+  uint32_t us = (now - mark) / profileCyclesPerUs;
+  StageProfile &p = stageProfiles[stage];
+
+  p.count++;
+  p.totalUs += us;
+  if (us < p.minUs) p.minUs = us;
+  if (us > p.maxUs) p.maxUs = us;
+
+  uint8_t bucket = 0;
+  for (uint32_t v = us; v > 1 && bucket < PROFILE_BUCKETS - 1; v >>= 1) bucket++;
+  p.buckets[bucket]++;
+
+  if (us > profileStallUs) {
+    StallRecord &r = stallLog[stallNext];
+    r.time = millis();
+    r.stage = stage;
+    r.us = us;
+    stallNext = (stallNext + 1) % PROFILE_STALL_LOG;
+    stallCount++;
+  }
+
+  // Measuring costs a few hundred cycles; keep it out of the next stage
+  return ESP.getCycleCount();
+}
+
+// Upper bound of the bucket holding the 99th percentile, capped at max
+uint32_t profileP99(uint8_t stage) {
+  const StageProfile &p = stageProfiles[stage];
+  uint32_t target = p.count - p.count / 100;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) {
+    seen += p.buckets[i];
+    if (seen >= target) {
+      uint32_t bound = 2UL << i;
+      return bound < p.maxUs ? bound : p.maxUs;
+    }
+  }
+  return p.maxUs;
+}
+
+uint32_t profileLoopHz() {
+  unsigned long elapsed = millis() - profileStart;
+  return elapsed ? (uint64_t)profileLoops * 1000 / elapsed : 0;
+}
+
+void printProfile() {
+  Serial.printf("[PROF] %u loops in %lus (%u Hz), stall threshold %uus\n",
+    profileLoops, (millis() - profileStart) / 1000, profileLoopHz(), profileStallUs);
+  Serial.println("[PROF] stage        count     min    mean     p99     max (us)");
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    const StageProfile &p = stageProfiles[i];
+    if (p.count == 0) continue;
+    Serial.printf("[PROF] %-9s %8u %7u %7u %7u %7u\n", STAGE_NAMES[i], p.count,
+      p.minUs, (uint32_t)(p.totalUs / p.count), profileP99(i), p.maxUs);
+  }
+
+  Serial.printf("[PROF] %u stalls\n", stallCount);
+  uint8_t shown = stallCount < PROFILE_STALL_LOG ? stallCount : PROFILE_STALL_LOG;
+  for (uint8_t n = 0; n < shown; n++) {
+    const StallRecord &r = stallLog[(stallNext + PROFILE_STALL_LOG - shown + n) % PROFILE_STALL_LOG];
+    Serial.printf("[PROF]   t=%lums %s %uus\n", r.time, STAGE_NAMES[r.stage], r.us);
+  }
+}
+
+// One line for the app: loop rate, slowest stage by p99 and stall count
+void formatProfileSummary(char* buffer, size_t size) {
+  uint8_t worst = 0;
+  uint32_t worstP99 = 0;
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    if (stageProfiles[i].count == 0) continue;
+    uint32_t p99 = profileP99(i);
+    if (p99 > worstP99) {
+      worstP99 = p99;
+      worst = i;
+    }
+  }
+  snprintf(buffer, size, "%uHz %s p99=%uus stalls=%u",
+    profileLoopHz(), STAGE_NAMES[worst], worstP99, stallCount);
+}
+
+// ========== OVERLAY MESSAGES ==========
+// Temporary two-line message screens. While an overlay is on screen
+// updateDisplay() leaves the LCD alone; when it expires the normal page
+// is redrawn. Nothing here blocks, so the rest of loop() keeps running.
+bool overlayActive = false;
+unsigned long overlayStart = 0;
+unsigned long overlayDuration = 0;
+
+void showOverlay(const char* line1, const char* line2, unsigned long duration) {
+  lcd.clear();
+  lcd.setCursor(0, 0);
+  lcd.print(line1);
+  lcd.setCursor(0, 1);
+  lcd.print(line2);
+
+  overlayActive = true;
+  overlayStart = millis();
+  overlayDuration = duration;
+}
+
+// Returns true while an overlay still owns the LCD
+bool updateOverlay() {
+  if (!overlayActive) return false;
+
+  if (millis() - overlayStart >= overlayDuration) {
+    overlayActive = false;
+    forceUpdate = true;
+    return false;
+  }
+  return true;
+}
+
+// ========== BUZZER PATTERNS ==========
+// A pattern is a list of durations in ms, alternating ON and OFF and
+// starting with ON, terminated by 0. updateBuzzer() steps through it
+// against millis() deadlines instead of delay().
+const uint16_t BEEP_CLICK[]        = {50, 0};
+const uint16_t BEEP_DOUBLE[]       = {100, 100, 100, 0};
+const uint16_t BEEP_LONG[]         = {300, 0};
+const uint16_t BEEP_HR_WARNING[]   = {100, 100, 100, 100, 100, 0};
+const uint16_t BEEP_TEMP_WARNING[] = {150, 150, 150, 0};
+
+const uint16_t* buzzerPattern = NULL;
+uint8_t buzzerStep = 0;
+unsigned long buzzerStepStart = 0;
+
+void playPattern(const uint16_t* pattern) {
+  // The alarm drives the buzzer itself while ringing
+  if (alarmRinging) return;
+
+  buzzerPattern = pattern;
+  buzzerStep = 0;
+  buzzerStepStart = millis();
+  halBuzzer(true);
+}
+
+void stopPattern() {
+  if (buzzerPattern == NULL) return;
+  buzzerPattern = NULL;
+  halBuzzer(false);
+}
+
+void updateBuzzer() {
+  if (buzzerPattern == NULL) return;
+  if (millis() - buzzerStepStart < buzzerPattern[buzzerStep]) return;
+
+  buzzerStepStart = millis();
+  buzzerStep++;
+
+  if (buzzerPattern[buzzerStep] == 0) {
+    stopPattern();
+  } else {
+    halBuzzer(buzzerStep % 2 == 0);
+  }
+}
+
+// ========== TIMEKEEPING ==========
+// The DS1302 is read (one burst transaction) at boot and every
+// CLOCK_RESYNC_INTERVAL. In between, clockTick() advances a cached
+// calendar time from millis(), corrected by the drift measured between
+// millis() and the RTC since the anchor read. clockTick() runs once at
+// the top of loop(), so every function in a pass sees the same time.
+const unsigned long CLOCK_RESYNC_INTERVAL = 600000;  // 10 minutes
+const uint32_t CLOCK_DRIFT_MIN_SPAN = 3600;         // s before trusting drift
+const int32_t CLOCK_DRIFT_LIMIT = 500;               // ppm
+const uint32_t CLOCK_UNIX_2000 = 946684800;          // Unix time of our epoch
+const int32_t CLOCK_UTC_OFFSET = 7 * 3600;           // RTC keeps local time (UTC+7)
+
+uint32_t clockBaseEpoch = 0;       // RTC seconds at clockBaseMillis
+unsigned long clockBaseMillis = 0;
+uint32_t clockAnchorEpoch = 0;     // First read of the current drift span
+unsigned long clockAnchorMillis = 0;
+int32_t clockDriftPpm = 0;         // millis() fast (+) or slow (-) vs RTC
+unsigned long lastClockSync = 0;
+bool clockSynced = false;
+
+uint32_t clockEpoch = 0xFFFFFFFF;  // Seconds since 2000-01-01 for this pass
+Time clockTime;                    // Same instant as calendar fields
+int32_t clockJump = 0;             // s the last resync stepped, for clockTick()
+
+bool isLeapYear(uint16_t year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+uint8_t daysInMonth(uint16_t year, uint8_t month) {
+  static const uint8_t DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if (month == 2 && isLeapYear(year)) return 29;
+  return DAYS[month - 1];
+}
+
+uint32_t timeToEpoch(const Time &t) {
+  if (t.year < 2000 || t.mon < 1 || t.mon > 12 || t.date < 1) return 0;
+
+  uint32_t days = 0;
+  for (uint16_t y = 2000; y < t.year; y++) days += isLeapYear(y) ? 366 : 365;
+  for (uint8_t m = 1; m < t.mon; m++) days += daysInMonth(t.year, m);
+  days += t.date - 1;
+
+  return days * 86400UL + t.hour * 3600UL + t.min * 60UL + t.sec;
+}
+
+void epochToTime(uint32_t epoch, Time &t) {
+  uint32_t days = epoch / 86400UL;
+  uint32_t secs = epoch % 86400UL;
+
+  t.hour = secs / 3600;
+  t.min = (secs / 60) % 60;
+  t.sec = secs % 60;
+  t.dow = (days + 5) % 7 + 1;  // 2000-01-01 was a Saturday (DS1302: Mon=1)
+
+  uint16_t year = 2000;
+  while (days >= (uint32_t)(isLeapYear(year) ? 366 : 365)) {
+    days -= isLeapYear(year) ? 366 : 365;
+    year++;
+  }
+  uint8_t month = 1;
+  while (days >= daysInMonth(year, month)) {
+    days -= daysInMonth(year, month);
+    month++;
+  }
+  t.year = year;
+  t.mon = month;
+  t.date = days + 1;
+}
+
+// Seconds since the base read, with the measured millis() drift removed
+uint32_t clockElapsed(unsigned long now) {
+  int64_t elapsedMs = (int64_t)(now - clockBaseMillis);
+  elapsedMs -= elapsedMs * clockDriftPpm / 1000000;
+  return (uint32_t)(elapsedMs / 1000);
+}
+
+void clockSync() {
+  uint32_t rtcEpoch = timeToEpoch(halRtcRead());
+  unsigned long now = millis();
+  lastClockSync = now;
+
+  if (!clockSynced) {
+    clockSynced = true;
+    clockBaseEpoch = clockAnchorEpoch = rtcEpoch;
+    clockBaseMillis = clockAnchorMillis = now;
+    return;
+  }
+
+  uint32_t predicted = clockBaseEpoch + clockElapsed(now);
+
+  // The RTC truncates to whole seconds, so a one-second lead is just
+  // phase; keep the current base to avoid stepping the display back
+  if (predicted == rtcEpoch || predicted == rtcEpoch + 1) {
+    // In step
+  } else if (predicted > rtcEpoch + 5 || rtcEpoch > predicted + 5) {
+    // RTC was set or glitched: start a new drift span
+    clockJump = (int32_t)(rtcEpoch - predicted);
+    clockAnchorEpoch = rtcEpoch;
+    clockAnchorMillis = now;
+    clockDriftPpm = 0;
+    clockBaseEpoch = rtcEpoch;
+    clockBaseMillis = now;
+  } else {
+    clockBaseEpoch = rtcEpoch;
+    clockBaseMillis = now;
+  }
+
+  uint32_t span = rtcEpoch > clockAnchorEpoch ? rtcEpoch - clockAnchorEpoch : 0;
+  if (span >= CLOCK_DRIFT_MIN_SPAN) {
+    int64_t errorMs = (int64_t)(now - clockAnchorMillis) - (int64_t)span * 1000;
+    clockDriftPpm = constrain((int32_t)(errorMs * 1000 / span), -CLOCK_DRIFT_LIMIT, CLOCK_DRIFT_LIMIT);
+  }
+
+  Serial.printf("[CLOCK] Resync: predicted %+d s, drift %d ppm\n",
+    (int)(predicted - rtcEpoch), (int)clockDriftPpm);
+}
+
+void clockTick() {
+  if (!clockSynced || millis() - lastClockSync >= CLOCK_RESYNC_INTERVAL) {
+    clockSync();
+  }
+
+  uint32_t epoch = clockBaseEpoch + clockElapsed(millis());
+  if (epoch != clockEpoch) {
+    clockEpoch = epoch;
+    epochToTime(epoch, clockTime);
+  }
+
+  if (clockJump != 0) {
+    alarmClockJumped(clockJump);
+    clockJump = 0;
+  }
+}
+
+const Time& clockNow() {
+  return clockTime;
+}
+
+// ========== HELPER FUNCTIONS ==========
+// Writes a fixed-point value with 'decimals' digits after the point,
+// e.g. (-53, 1) -> "-5.3". Integer only, so no float printf support
+// gets pulled in. Returns the length written.
+uint8_t formatFixed(char* buffer, size_t size, int32_t value, uint8_t decimals) {
+  char digits[12];
+  uint8_t n = 0;
+  uint32_t v = value < 0 ? -(uint32_t)value : value;
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v > 0 || n <= decimals);
+
+  size_t len = 0;
+  if (value < 0 && len + 1 < size) buffer[len++] = '-';
+  while (n > 0 && len + 1 < size) {
+    if (n == decimals) {
+      buffer[len++] = '.';
+      if (len + 1 >= size) break;
+    }
+    buffer[len++] = digits[--n];
+  }
+  if (size > 0) buffer[len] = '\0';
+  return (uint8_t)len;
+}
+
+// Fields are clamped to their digit count, so "HH:MM:SS" and
+// "DD/MM/YYYY" always fit 9 and 11 bytes, even for a garbled RTC read
+void formatTime(char* buffer, size_t size) {
+  const Time &t = clockNow();
+  snprintf(buffer, size, "%02u:%02u:%02u", t.hour % 100u, t.min % 100u, t.sec % 100u);
+}
+
+void formatDate(char* buffer, size_t size) {
+  const Time &t = clockNow();
+  snprintf(buffer, size, "%02u/%02u/%04u", t.date % 100u, t.mon % 100u, t.year % 10000u);
+}
+
+// ========== LOGGING ==========
+// logMessage() formats once into a stack buffer, prints "[TAG] text" to
+// Serial and queues "[HH:MM:SS] text" for the Blynk terminal. The queue
+// is a fixed ring of lines; flushTerminal() sends everything pending once
+// online, as few writes as fit. No String or heap allocation involved.
+const uint8_t TERMINAL_QUEUE_SIZE = 8;
+const uint8_t TERMINAL_LINE_LEN = 64;
+const uint8_t LOG_MESSAGE_LEN = 52;
+
+// Blynk builds each message in a BLYNK_MAX_SENDBYTES buffer holding
+// "vw", the pin and the value, each NUL-terminated; a value that does not
+// fit is silently left out. 8 bytes covers the rest for pins up to V99.
+const uint8_t TERMINAL_BATCH_MAX = BLYNK_MAX_SENDBYTES - 8;
+
+char terminalQueue[TERMINAL_QUEUE_SIZE][TERMINAL_LINE_LEN];
+uint8_t terminalTail = 0;   // Oldest pending line
+uint8_t terminalCount = 0;
+uint32_t terminalDropped = 0;
+
+void queueTerminalLine(const char* text) {
+  if (terminalCount == TERMINAL_QUEUE_SIZE) {
+    // Full: overwrite the oldest line
+    terminalTail = (terminalTail + 1) % TERMINAL_QUEUE_SIZE;
+    terminalCount--;
+    terminalDropped++;
+  }
+
+  char* line = terminalQueue[(terminalTail + terminalCount) % TERMINAL_QUEUE_SIZE];
+  const Time &t = clockNow();
+  snprintf(line, TERMINAL_LINE_LEN, "[%02d:%02d:%02d] %s", t.hour, t.min, t.sec, text);
+  terminalCount++;
+}
+
+void logMessage(const char* tag, const char* format, ...) {
+  char text[LOG_MESSAGE_LEN];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+
+  Serial.printf("[%s] %s\n", tag, text);
+  queueTerminalLine(text);
+}
+
+// Joins pending lines into writes of at most TERMINAL_BATCH_MAX bytes.
+// A line is shorter than TERMINAL_LINE_LEN, so every write takes at
+// least one.
+void flushTerminal() {
+  if (!wifiConnected) return;
+
+  char batch[TERMINAL_BATCH_MAX + 1];
+  while (terminalCount > 0) {
+    size_t len = 0;
+    while (terminalCount > 0) {
+      const char* line = terminalQueue[terminalTail];
+      size_t lineLen = strlen(line);
+      if (len + lineLen + 1 > TERMINAL_BATCH_MAX) break;
+      memcpy(batch + len, line, lineLen);
+      len += lineLen;
+      batch[len++] = '\n';
+
+      terminalTail = (terminalTail + 1) % TERMINAL_QUEUE_SIZE;
+      terminalCount--;
+    }
+    batch[len] = '\0';
+    halBlynkWrite(V_TERMINAL, batch);
+  }
+}
+
+// ========== PPG SAMPLING ==========
+// Drains the MAX30102 FIFO in one burst and queues the samples with
+// timestamps derived from the sensor's own sample rate, so beat timing
+// no longer depends on how long the rest of loop() took.
+const uint8_t PPG_RING_SIZE = 64;               // Power of two
+const unsigned long PPG_SAMPLE_PERIOD = 10;     // ms, 100 samples/s
+const unsigned long PPG_DRAIN_INTERVAL = 40;    // FIFO holds 320 ms
+const unsigned long PPG_RESYNC_TOLERANCE = 30;  // ms
+
+PpgSample ppgRing[PPG_RING_SIZE];
+uint8_t ppgHead = 0;
+uint8_t ppgTail = 0;
+unsigned long ppgSampleClock = 0;
+unsigned long lastPpgDrain = 0;
+
+void ppgPush(unsigned long time, uint32_t ir, uint32_t red) {
+  uint8_t next = (ppgHead + 1) & (PPG_RING_SIZE - 1);
+  if (next == ppgTail) {
+    // Full: drop the oldest sample rather than the newest
+    ppgTail = (ppgTail + 1) & (PPG_RING_SIZE - 1);
+    ppgDropped++;
+  }
+  ppgRing[ppgHead].time = time;
+  ppgRing[ppgHead].ir = ir;
+  ppgRing[ppgHead].red = red;
+  ppgHead = next;
+}
+
+bool ppgPop(PpgSample &sample) {
+  if (ppgTail == ppgHead) return false;
+  sample = ppgRing[ppgTail];
+  ppgTail = (ppgTail + 1) & (PPG_RING_SIZE - 1);
+  return true;
+}
+
+void samplePpg() {
+  // With the INT pin wired, drain when the sensor asks for it; the
+  // interval still acts as a fallback so a missed edge cannot stall us
+  if (!halPpgInterrupt() && millis() - lastPpgDrain < PPG_DRAIN_INTERVAL) return;
+  lastPpgDrain = millis();
+
+  uint32_t red[MAX30102_FIFO_DEPTH];
+  uint32_t ir[MAX30102_FIFO_DEPTH];
+  uint8_t count = halPpgReadFifo(red, ir, MAX30102_FIFO_DEPTH);
+  if (count == 0) return;
+
+  // Keep the sample clock on the sensor's cadence, re-anchoring to
+  // millis() only after lost samples or at startup
+  unsigned long now = millis();
+  unsigned long expected = ppgSampleClock + count * PPG_SAMPLE_PERIOD;
+  if (now - expected > PPG_RESYNC_TOLERANCE && expected - now > PPG_RESYNC_TOLERANCE) {
+    ppgSampleClock = now - count * PPG_SAMPLE_PERIOD;
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    ppgSampleClock += PPG_SAMPLE_PERIOD;
+    ppgPush(ppgSampleClock, ir[i], red[i]);
+  }
+}
+
+// ========== BEAT DETECTION ==========
+// Integer-only pipeline, run on every 100 Hz IR sample:
+//   1. DC removal: slow IIR baseline (~0.25 Hz), subtracted and inverted
+//      so the systolic dip in reflected light becomes a positive peak
+//   2. Low-pass IIR (~4 Hz) to suppress sensor and ambient noise
+//   3. Peak detection against half of a decaying amplitude envelope,
+//      with a refractory period that caps the rate at 200 BPM
+//   4. Rate = 60000 / median of recent beat intervals; intervals that
+//      deviate more than 25% from the median are rejected as outliers
+// All state is in Q4 fixed point (value << 4). Define
+// PPG_USE_LIBRARY_DETECTOR to fall back to the library checkForBeat()
+// for A/B comparison; PERF reports cycles per sample for either build.
+// #define PPG_USE_LIBRARY_DETECTOR
+
+const unsigned long BEAT_REFRACTORY = 300;    // ms, 200 BPM
+const unsigned long IBI_MIN = 300;            // ms, 200 BPM
+const unsigned long IBI_MAX = 2000;           // ms, 30 BPM
+const int32_t PPG_MIN_AMPLITUDE = 20 << 4;    // Ignore sub-noise wiggles
+const uint8_t IBI_HISTORY = 8;
+const uint8_t IBI_MEDIAN_WINDOW = 5;
+const uint8_t IBI_MIN_FOR_RATE = 3;
+const uint8_t IBI_MAX_REJECTS = 3;            // Then assume the rate changed
+
+int32_t ppgDc = 0;
+int32_t ppgFiltered = 0;
+int32_t ppgEnvelope = 0;
+int32_t ppgPeak = 0;
+unsigned long ppgPeakTime = 0;
+bool ppgAboveThreshold = false;
+
+uint16_t ibiHistory[IBI_HISTORY];
+uint8_t ibiCount = 0;
+uint8_t ibiNext = 0;
+uint8_t ibiRejects = 0;
+
+void resetBeatDetector() {
+  ppgDc = 0;
+  ppgFiltered = 0;
+  ppgEnvelope = 0;
+  ppgAboveThreshold = false;
+  ibiCount = 0;
+  ibiNext = 0;
+  ibiRejects = 0;
+  lastBeat = 0;
+  heartRate = 0;
+  hrConfidence = 0;
+  resetHrv();
+}
+
+// Returns true when a beat peak is confirmed; beatTime is the peak's time
+bool detectBeat(const PpgSample &sample, unsigned long &beatTime) {
+#ifdef PPG_USE_LIBRARY_DETECTOR
+  beatTime = sample.time;
+  return checkForBeat(sample.ir);
+#else
+  int32_t x = (int32_t)sample.ir << 4;
+
+  if (ppgDc == 0) ppgDc = x;
+  ppgDc += (x - ppgDc) >> 6;
+  ppgFiltered += ((ppgDc - x) - ppgFiltered) >> 2;
+
+  int32_t v = ppgFiltered;
+  ppgEnvelope -= ppgEnvelope >> 7;   // ~1.3 s decay
+  if (v > ppgEnvelope) ppgEnvelope = v;
+  int32_t threshold = ppgEnvelope >> 1;
+
+  if (!ppgAboveThreshold) {
+    if (v > threshold && v > PPG_MIN_AMPLITUDE) {
+      ppgAboveThreshold = true;
+      ppgPeak = v;
+      ppgPeakTime = sample.time;
+    }
+    return false;
+  }
+
+  if (v > ppgPeak) {
+    ppgPeak = v;
+    ppgPeakTime = sample.time;
+    return false;
+  }
+  if (v > threshold) return false;
+
+  // Fell back below threshold: the maximum seen was the beat
+  ppgAboveThreshold = false;
+  if (lastBeat != 0 && ppgPeakTime - lastBeat < BEAT_REFRACTORY) return false;
+  beatTime = ppgPeakTime;
+  return true;
+#endif
+}
+
+uint16_t medianInterval(uint8_t window) {
+  uint16_t sorted[IBI_MEDIAN_WINDOW];
+  uint8_t n = window < ibiCount ? window : ibiCount;
+
+  for (uint8_t i = 0; i < n; i++) {
+    uint16_t value = ibiHistory[(ibiNext + IBI_HISTORY - 1 - i) % IBI_HISTORY];
+    uint8_t j = i;
+    while (j > 0 && sorted[j - 1] > value) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+  }
+  return sorted[n / 2];
+}
+
+void addBeatInterval(unsigned long ibi) {
+  if (ibi < IBI_MIN || ibi > IBI_MAX) {
+    hrvBreak();
+    return;
+  }
+
+  if (ibiCount >= IBI_MIN_FOR_RATE) {
+    uint16_t median = medianInterval(IBI_MEDIAN_WINDOW);
+    uint16_t tolerance = median / 4;
+    if (ibi + tolerance < median || ibi > median + tolerance) {
+      // Outlier (missed or extra beat). A run of them means the rate
+      // really changed, so start over from the new rhythm.
+      hrvBreak();
+      if (++ibiRejects < IBI_MAX_REJECTS) return;
+      ibiCount = 0;
+    }
+  }
+  ibiRejects = 0;
+  hrvAddInterval(ibi);
+
+  ibiHistory[ibiNext] = ibi;
+  ibiNext = (ibiNext + 1) % IBI_HISTORY;
+  if (ibiCount < IBI_HISTORY) ibiCount++;
+
+  if (ibiCount < IBI_MIN_FOR_RATE) return;
+
+  uint16_t median = medianInterval(IBI_MEDIAN_WINDOW);
+  heartRate = (60000UL + median / 2) / median;
+  healthSample(SOURCE_HEART_RATE);
+
+  // Confidence: history depth times spread (mean absolute deviation)
+  uint8_t n = ibiCount < IBI_MEDIAN_WINDOW ? ibiCount : IBI_MEDIAN_WINDOW;
+  uint32_t deviation = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    int32_t d = (int32_t)ibiHistory[(ibiNext + IBI_HISTORY - 1 - i) % IBI_HISTORY] - median;
+    deviation += d < 0 ? -d : d;
+  }
+  uint32_t spreadPercent = deviation * 100 / n / median;
+  int depth = ibiCount * 100 / IBI_HISTORY;
+  int spread = spreadPercent >= 25 ? 0 : 100 - spreadPercent * 4;
+  hrConfidence = depth * spread / 100;
+}
+
+// ========== HEART RATE VARIABILITY ==========
+// Accepted beat intervals go into a ring of HRV_WINDOW entries. Running
+// sums are adjusted for the interval that enters and the one that falls
+// out, so each beat costs O(1) regardless of window size:
+//   SDNN  from sum and sum of squares of the intervals
+//   RMSSD from the sum of squared successive differences
+//   pNN50 from the count of successive differences over 50 ms
+// Each interval stores its difference to the previous one. After a gap
+// (rejected beat, finger off) there is no valid difference to store.
+const int16_t HRV_NO_DIFF = 0x7FFF;
+
+uint16_t hrvIntervals[HRV_WINDOW];
+int16_t hrvDiffs[HRV_WINDOW];
+uint8_t hrvNext = 0;
+uint32_t hrvSum = 0;
+uint32_t hrvSumSq = 0;
+uint32_t hrvDiffSqSum = 0;
+uint8_t hrvDiffCount = 0;
+uint8_t hrvNn50Count = 0;
+uint16_t hrvPrevInterval = 0;   // 0 = gap, no successive difference
+
+uint16_t isqrt32(uint32_t x) {
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > x) bit >>= 2;
+  while (bit != 0) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+void hrvAccumulateDiff(int16_t diff, int sign) {
+  if (diff == HRV_NO_DIFF) return;
+  uint32_t square = (int32_t)diff * diff;
+  bool nn50 = diff > 50 || diff < -50;
+  if (sign > 0) {
+    hrvDiffSqSum += square;
+    hrvDiffCount++;
+    if (nn50) hrvNn50Count++;
+  } else {
+    hrvDiffSqSum -= square;
+    hrvDiffCount--;
+    if (nn50) hrvNn50Count--;
+  }
+}
+
+void hrvAddInterval(uint16_t ibi) {
+  if (hrvCount == HRV_WINDOW) {
+    // Window full: retire the oldest interval, which sits in the slot
+    // about to be overwritten
+    uint16_t old = hrvIntervals[hrvNext];
+    hrvSum -= old;
+    hrvSumSq -= (uint32_t)old * old;
+    hrvAccumulateDiff(hrvDiffs[hrvNext], -1);
+    hrvCount--;
+  }
+
+  int16_t diff = hrvPrevInterval ? (int16_t)(ibi - hrvPrevInterval) : HRV_NO_DIFF;
+  hrvIntervals[hrvNext] = ibi;
+  hrvDiffs[hrvNext] = diff;
+  hrvNext = (hrvNext + 1) % HRV_WINDOW;
+  hrvCount++;
+  hrvPrevInterval = ibi;
+
+  hrvSum += ibi;
+  hrvSumSq += (uint32_t)ibi * ibi;
+  hrvAccumulateDiff(diff, +1);
+
+  if (hrvCount > 1) {
+    uint64_t sum = hrvSum;
+    uint32_t variance = (hrvSumSq - sum * sum / hrvCount) / (hrvCount - 1);
+    hrvSdnn = isqrt32(variance);
+  }
+  if (hrvDiffCount > 0) {
+    hrvRmssd = isqrt32(hrvDiffSqSum / hrvDiffCount);
+    hrvPnn50 = hrvNn50Count * 100 / hrvDiffCount;
+  }
+}
+
+// The next interval does not follow the last one (missed beat etc.)
+void hrvBreak() {
+  hrvPrevInterval = 0;
+}
+
+void resetHrv() {
+  hrvCount = 0;
+  hrvNext = 0;
+  hrvSum = 0;
+  hrvSumSq = 0;
+  hrvDiffSqSum = 0;
+  hrvDiffCount = 0;
+  hrvNn50Count = 0;
+  hrvPrevInterval = 0;
+  hrvRmssd = 0;
+  hrvSdnn = 0;
+  hrvPnn50 = 0;
+}
+
+// ========== HEART RATE READING ==========
+void processPpgSample(const PpgSample &sample) {
+  irValue = sample.ir;
+
+  if (irValue > 50000 && irValue < 200000) {
+    fingerDetected = true;
+  } else {
+    if (fingerDetected) {
+      lastFingerRemoved = sample.time;
+      fingerDetected = false;
+      healthSample(SOURCE_HEART_RATE);   // Ends any heart rate episode
+    }
+  }
+
+  unsigned long beatTime;
+  if (fingerDetected && detectBeat(sample, beatTime)) {
+    if (lastBeat != 0) addBeatInterval(beatTime - lastBeat);
+    lastBeat = beatTime;
+  }
+}
+
+void readHeartRate() {
+  samplePpg();
+
+  PpgSample sample;
+  uint32_t start = ESP.getCycleCount();
+  uint32_t processed = 0;
+  while (ppgPop(sample)) {
+    processPpgSample(sample);
+    processed++;
+  }
+  if (processed > 0) {
+    perfPpgCycles += ESP.getCycleCount() - start;
+    perfPpgSamples += processed;
+  }
+
+  // Finger off for 2 s: drop the rate and the interval history, so the
+  // next reading starts clean instead of averaging in stale values
+  if (!fingerDetected && millis() - lastFingerRemoved > 2000 && lastBeat != 0) {
+    resetBeatDetector();
+  }
+}
+
+// ========== SENSOR READING ==========
+// Only starts the DHT conversion; pollSensors() picks up the result a
+// few loop() passes later
+void readSensors() {
+  halDhtStart();
+}
+
+void pollSensors() {
+  int16_t h, t;
+  
+  if (halDhtPoll(h, t)) {
+    humidity = h;
+    temperature = t;
+    updateRollups();
+    healthSample(SOURCE_TEMPERATURE);
+  }
+}
+
+// ========== ROLLUPS ==========
+// Min/max/mean history at two resolutions, updated as readings arrive:
+//   tier 0   60 buckets x 1 min   (last hour)
+//   tier 1   96 buckets x 15 min  (last 24 h)
+// Values are fixed point in int16 cells: temperature and humidity in 0.1
+// units, heart rate in BPM. Each tier accumulates the open bucket; when
+// the clock moves into a new bucket the open one is written to the ring
+// and buckets skipped meanwhile (device off, no readings) become empty.
+enum RollupMetric {
+  ROLL_TEMP,
+  ROLL_HUMIDITY,
+  ROLL_HEARTRATE,
+  ROLL_METRICS
+};
+
+const int16_t ROLL_EMPTY = -32768;
+const uint8_t ROLL_TIERS = 2;
+
+struct RollupTier {
+  uint16_t bucketSeconds;
+  uint8_t size;
+  RollupCell* cells;               // [metric * size + bucket % size]
+  RollupAccum open[ROLL_METRICS];
+  uint32_t bucket;                 // Open bucket number, 0 = not started
+};
+
+RollupCell rollMinuteCells[ROLL_METRICS * 60];
+RollupCell rollQuarterCells[ROLL_METRICS * 96];
+
+RollupTier rollTiers[ROLL_TIERS] = {
+  {60, 60, rollMinuteCells, {}, 0},
+  {900, 96, rollQuarterCells, {}, 0},
+};
+
+void resetRollAccum(RollupAccum &a) {
+  a.min = 32767;
+  a.max = -32767;
+  a.sum = 0;
+  a.count = 0;
+}
+
+void resetRollups() {
+  for (uint8_t t = 0; t < ROLL_TIERS; t++) {
+    RollupTier &tier = rollTiers[t];
+    for (uint16_t i = 0; i < ROLL_METRICS * tier.size; i++) {
+      tier.cells[i].min = tier.cells[i].max = tier.cells[i].mean = ROLL_EMPTY;
+    }
+    for (uint8_t m = 0; m < ROLL_METRICS; m++) resetRollAccum(tier.open[m]);
+    tier.bucket = 0;
+  }
+}
+
+void advanceRollTier(uint8_t t, uint32_t bucket) {
+  RollupTier &tier = rollTiers[t];
+  if (bucket == tier.bucket) return;
+
+  if (tier.bucket != 0) {
+    for (uint8_t m = 0; m < ROLL_METRICS; m++) {
+      RollupAccum &a = tier.open[m];
+      RollupCell &c = tier.cells[m * tier.size + tier.bucket % tier.size];
+      if (a.count) {
+        c.min = a.min;
+        c.max = a.max;
+        c.mean = a.sum / a.count;
+      } else {
+        c.min = c.max = c.mean = ROLL_EMPTY;
+      }
+      resetRollAccum(a);
+    }
+
+    // Clear the buckets that were skipped (the whole ring at most)
+    uint32_t gap = bucket > tier.bucket ? bucket - tier.bucket - 1 : 0;
+    if (gap > tier.size) gap = tier.size;
+    for (uint32_t b = bucket - gap; b < bucket; b++) {
+      for (uint8_t m = 0; m < ROLL_METRICS; m++) {
+        RollupCell &c = tier.cells[m * tier.size + b % tier.size];
+        c.min = c.max = c.mean = ROLL_EMPTY;
+      }
+    }
+  }
+  tier.bucket = bucket;
+}
+
+void addRollValue(uint8_t metric, int16_t value) {
+  for (uint8_t t = 0; t < ROLL_TIERS; t++) {
+    RollupAccum &a = rollTiers[t].open[metric];
+    if (value < a.min) a.min = value;
+    if (value > a.max) a.max = value;
+    a.sum += value;
+    a.count++;
+  }
+}
+
+// Called with every new DHT reading (about every 2 s)
+void updateRollups() {
+  if (!clockSynced) return;
+  for (uint8_t t = 0; t < ROLL_TIERS; t++) {
+    advanceRollTier(t, clockEpoch / rollTiers[t].bucketSeconds);
+  }
+  addRollValue(ROLL_TEMP, temperature);
+  addRollValue(ROLL_HUMIDITY, humidity);
+  if (fingerDetected && heartRate > 0) addRollValue(ROLL_HEARTRATE, heartRate);
+}
+
+// Cell for the bucket 'age' buckets before the open one; age 0 is the
+// open bucket itself, summarised so far
+RollupCell getRollCell(uint8_t t, uint8_t metric, uint16_t age) {
+  const RollupTier &tier = rollTiers[t];
+  RollupCell c = {ROLL_EMPTY, ROLL_EMPTY, ROLL_EMPTY};
+  if (tier.bucket == 0 || age >= tier.size) return c;
+
+  if (age == 0) {
+    const RollupAccum &a = tier.open[metric];
+    if (a.count) {
+      c.min = a.min;
+      c.max = a.max;
+      c.mean = a.sum / a.count;
+    }
+    return c;
+  }
+  return tier.cells[metric * tier.size + (tier.bucket - age) % tier.size];
+}
+
+// ========== TREND PAGE ==========
+// Sparkline of one metric over the newest 40 buckets of a tier, drawn
+// with the HD44780's 8 custom characters (8 x 5 pixel columns). Each
+// column is a bar from the bucket's min to its max, scaled to the range
+// on screen. The page cycles through metric/tier views. Character codes
+// 8-15 show the same glyphs as 0-7, so the line stays a C string.
+const uint8_t TREND_GLYPHS = 8;
+const uint8_t TREND_COLUMNS = TREND_GLYPHS * 5;
+const unsigned long TREND_VIEW_INTERVAL = 3000;
+
+const char* ROLL_LABELS[ROLL_METRICS] = {"T", "H", "HR"};
+const char* TREND_SPANS[ROLL_TIERS] = {"40m", "10h"};
+
+uint8_t trendView = 0;
+unsigned long lastTrendView = 0;
+
+// At most 4 characters, so "T40m lo-hi" fits its 14-column slot: a
+// temperature from -10.0 or 100.0 C on is shown in whole degrees
+void formatRollValue(uint8_t metric, int16_t v, char* buffer, size_t size) {
+  if (metric == ROLL_TEMP && (v <= -100 || v >= 1000)) {
+    formatFixed(buffer, size, (v + (v < 0 ? -5 : 5)) / 10, 0);
+  } else if (metric == ROLL_TEMP) {
+    formatFixed(buffer, size, v, 1);
+  } else if (metric == ROLL_HUMIDITY) {
+    formatFixed(buffer, size, (v + 5) / 10, 0);
+  } else {
+    formatFixed(buffer, size, v, 0);
+  }
+}
+
+RollupCell trendCols[TREND_COLUMNS];
+int16_t trendLo = 0;
+int16_t trendHi = 0;
+int16_t trendMean = 0;
+uint8_t trendUsed = 0;
+
+void nextTrendView() {
+  lastTrendView = millis();
+  trendView = (trendView + 1) % (ROLL_METRICS * ROLL_TIERS);
+}
+
+void prepareTrendPage() {
+  if (millis() - lastTrendView >= TREND_VIEW_INTERVAL) nextTrendView();
+  uint8_t metric = trendView % ROLL_METRICS;
+  uint8_t tier = trendView / ROLL_METRICS;
+
+  trendLo = 32767;
+  trendHi = -32767;
+  int32_t meanSum = 0;
+  trendUsed = 0;
+  for (uint8_t c = 0; c < TREND_COLUMNS; c++) {
+    trendCols[c] = getRollCell(tier, metric, TREND_COLUMNS - 1 - c);
+    if (trendCols[c].mean == ROLL_EMPTY) continue;
+    if (trendCols[c].min < trendLo) trendLo = trendCols[c].min;
+    if (trendCols[c].max > trendHi) trendHi = trendCols[c].max;
+    meanSum += trendCols[c].mean;
+    trendUsed++;
+  }
+  if (trendUsed) trendMean = meanSum / trendUsed;
+}
+
+void renderTrendTitle(char* buffer, size_t size) {
+  uint8_t metric = trendView % ROLL_METRICS;
+  uint8_t tier = trendView / ROLL_METRICS;
+  if (trendUsed == 0) {
+    snprintf(buffer, size, "%s%s no data", ROLL_LABELS[metric], TREND_SPANS[tier]);
+    return;
+  }
+
+  char loText[8], hiText[8];
+  formatRollValue(metric, trendLo, loText, sizeof(loText));
+  formatRollValue(metric, trendHi, hiText, sizeof(hiText));
+  snprintf(buffer, size, "%s%s %s-%s", ROLL_LABELS[metric], TREND_SPANS[tier], loText, hiText);
+}
+
+void renderTrendGraph(char* buffer, size_t size) {
+  buffer[0] = '\0';
+  if (trendUsed == 0) return;
+
+  uint8_t glyphs[TREND_GLYPHS][8];
+  memset(glyphs, 0, sizeof(glyphs));
+  int16_t range = trendHi - trendLo;
+  for (uint8_t c = 0; c < TREND_COLUMNS; c++) {
+    if (trendCols[c].mean == ROLL_EMPTY) continue;
+    uint8_t y0 = range ? (int32_t)(trendCols[c].min - trendLo) * 7 / range : 3;
+    uint8_t y1 = range ? (int32_t)(trendCols[c].max - trendLo) * 7 / range : 3;
+    for (uint8_t y = y0; y <= y1; y++) {
+      glyphs[c / 5][7 - y] |= 0x10 >> (c % 5);
+    }
+  }
+
+  char glyphText[TREND_GLYPHS + 1];
+  for (uint8_t g = 0; g < TREND_GLYPHS; g++) {
+    lcd.createChar(g, glyphs[g]);
+    glyphText[g] = 8 + g;
+  }
+  glyphText[TREND_GLYPHS] = '\0';
+
+  // 8 glyphs + "avg" + the mean right-aligned in 5 columns is exactly
+  // one row; means are at most 4 characters ("-9.9", "100")
+  char meanText[8];
+  formatRollValue(trendView % ROLL_METRICS, trendMean, meanText, sizeof(meanText));
+  snprintf(buffer, size, "%savg%5s", glyphText, meanText);
+}
+
+// ========== TELEMETRY PUBLISHER ==========
+// Remembers what was last sent on each virtual pin and only sends again
+// when the value moved by at least the channel's deadband, or when
+// TELEMETRY_REFRESH_INTERVAL passed without a send. minInterval caps how
+// often a channel may go out (the clock would otherwise send every
+// second). Each send is a single frame; live values are not grouped,
+// as a group would add two frames to every batch.
+enum TelemetryChannelId {
+  TM_TIME,
+  TM_DATE,
+  TM_TEMP,
+  TM_HUMIDITY,
+  TM_HEARTRATE,
+  TM_STATUS,
+  TM_HRV_RMSSD,
+  TM_HRV_SDNN,
+  TM_HRV_PNN50,
+  TM_PROFILE,
+  TM_COUNT
+};
+
+struct TelemetryChannel {
+  uint8_t pin;
+  int32_t deadband;           // Numeric: in the channel's fixed-point units
+  unsigned long minInterval;
+  int32_t lastValue;          // Numeric: last value sent
+  uint32_t lastHash;          // Text: hash of last text sent
+  unsigned long lastSent;
+  bool sent;
+};
+
+const unsigned long TELEMETRY_CHECK_INTERVAL = 1000;
+const unsigned long TELEMETRY_REFRESH_INTERVAL = 60000;
+
+TelemetryChannel telemetry[TM_COUNT] = {
+  {V_TIME,      0,   3000, 0, 0, 0, false},
+  {V_DATE,      0,   0,    0, 0, 0, false},
+  {V_TEMP,      1,   0,    0, 0, 0, false},   // 0.1 °C
+  {V_HUMIDITY,  10,  0,    0, 0, 0, false},   // 0.1 %
+  {V_HEARTRATE, 1,   0,    0, 0, 0, false},
+  {V_STATUS,    0,   0,    0, 0, 0, false},
+  {V_HRV_RMSSD, 1,   0,    0, 0, 0, false},
+  {V_HRV_SDNN,  1,   0,    0, 0, 0, false},
+  {V_HRV_PNN50, 1,   0,    0, 0, 0, false},
+  {V_PROFILE,   0,   10000, 0, 0, 0, false},
+};
+
+// Forget what was sent, e.g. after a reconnect, so everything goes out again
+void resetTelemetry() {
+  for (uint8_t i = 0; i < TM_COUNT; i++) telemetry[i].sent = false;
+}
+
+// Decides whether a channel may send now
+bool telemetryShouldSend(uint8_t channel, bool changed) {
+  TelemetryChannel &c = telemetry[channel];
+  unsigned long now = millis();
+
+  if (c.sent) {
+    if (now - c.lastSent < c.minInterval) changed = false;
+    if (!changed && now - c.lastSent < TELEMETRY_REFRESH_INTERVAL) {
+      ioStats.blynkSuppressed++;
+      return false;
+    }
+  }
+
+  c.lastSent = now;
+  c.sent = true;
+  return true;
+}
+
+// value carries 'decimals' implied decimal places, sent as text
+void publishFixed(uint8_t channel, int32_t value, uint8_t decimals) {
+  TelemetryChannel &c = telemetry[channel];
+  bool changed = labs(value - c.lastValue) >= c.deadband;
+  if (!telemetryShouldSend(channel, changed)) return;
+
+  c.lastValue = value;
+  char text[12];
+  formatFixed(text, sizeof(text), value, decimals);
+  halBlynkWrite(c.pin, text);
+}
+
+void publishInt(uint8_t channel, int value) {
+  TelemetryChannel &c = telemetry[channel];
+  bool changed = labs(value - c.lastValue) >= c.deadband;
+  if (!telemetryShouldSend(channel, changed)) return;
+
+  c.lastValue = value;
+  halBlynkWrite(c.pin, value);
+}
+
+void publishText(uint8_t channel, const char* text) {
+  // FNV-1a: cheap, and collisions only cost one skipped update
+  uint32_t hash = 2166136261UL;
+  for (const char* p = text; *p; p++) {
+    hash = (hash ^ (uint8_t)*p) * 16777619UL;
+  }
+
+  TelemetryChannel &c = telemetry[channel];
+  if (!telemetryShouldSend(channel, hash != c.lastHash)) return;
+
+  c.lastHash = hash;
+  halBlynkWrite(c.pin, text);
+}
+
+// ========== OFFLINE STORE ==========
+// While offline, sendDataToBlynk() hands a sample to storeSample() every
+// STORE_INTERVAL. Samples go into a RAM ring as 16-bit deltas against the
+// previous sample, 8 bytes each. storeBase holds the absolute values of
+// the last sample taken out of the ring (uploaded or overwritten), so
+// the oldest record can always be decoded. Once online, serviceStore()
+// uploads the backlog with the original timestamps, a few records per
+// pass, so Blynk.run() keeps its share of the loop.
+const uint16_t STORE_CAPACITY = 256;                 // Records
+const unsigned long STORE_INTERVAL = 30000;          // ms between samples
+const uint8_t STORE_DRAIN_BATCH = 4;                 // Records per pass
+const unsigned long STORE_DRAIN_INTERVAL = 200;      // ms between passes
+
+struct StoreRecord {
+  uint16_t dt;        // s since the previous sample
+  int16_t dTemp;      // 0.1 C
+  int16_t dHumidity;  // 0.1 %
+  int16_t dHeartRate; // BPM
+};
+
+struct StoreSample {
+  uint32_t epoch;
+  int16_t temp;
+  int16_t humidity;
+  int16_t heartRate;
+};
+
+StoreRecord storeRing[STORE_CAPACITY];
+uint16_t storeHead = 0;
+uint16_t storeCount = 0;
+StoreSample storeBase;    // Last sample removed from the ring
+StoreSample storeLast;    // Newest sample in the ring
+unsigned long lastStoreSample = 0;
+unsigned long lastStoreDrain = 0;
+uint32_t storeOverwritten = 0;
+
+uint32_t storeDrainStart = 0;    // millis() when the current upload began
+uint16_t storeDrainSent = 0;
+
+// Decodes the oldest record into storeBase and drops it
+void storeTakeOldest() {
+  const StoreRecord &r = storeRing[(storeHead + STORE_CAPACITY - storeCount) % STORE_CAPACITY];
+  storeBase.epoch += r.dt;
+  storeBase.temp += r.dTemp;
+  storeBase.humidity += r.dHumidity;
+  storeBase.heartRate += r.dHeartRate;
+  storeCount--;
+}
+
+void storeSample() {
+  if (millis() - lastStoreSample < STORE_INTERVAL && lastStoreSample != 0) return;
+  lastStoreSample = millis();
+  if (!clockSynced) return;   // No trustworthy timestamp yet
+
+  StoreSample now;
+  now.epoch = clockEpoch;
+  now.temp = temperature;
+  now.humidity = humidity;
+  now.heartRate = fingerDetected ? heartRate : 0;
+
+  if (storeCount == 0) {
+    storeLast = now;
+    storeBase = now;   // Zero deltas decode back to now
+  } else if (storeCount == STORE_CAPACITY) {
+    storeTakeOldest();
+    storeOverwritten++;
+  }
+
+  uint32_t dt = now.epoch - storeLast.epoch;
+  StoreRecord &r = storeRing[storeHead];
+  r.dt = dt > 0xFFFF ? 0xFFFF : dt;
+  r.dTemp = now.temp - storeLast.temp;
+  r.dHumidity = now.humidity - storeLast.humidity;
+  r.dHeartRate = now.heartRate - storeLast.heartRate;
+  storeHead = (storeHead + 1) % STORE_CAPACITY;
+  storeCount++;
+
+  // Keep storeLast exactly what decoding will produce
+  storeLast.epoch += r.dt;
+  storeLast.temp = now.temp;
+  storeLast.humidity = now.humidity;
+  storeLast.heartRate = now.heartRate;
+}
+
+void serviceStore() {
+  if (!wifiConnected || storeCount == 0) return;
+  if (millis() - lastStoreDrain < STORE_DRAIN_INTERVAL) return;
+  lastStoreDrain = millis();
+
+  if (storeDrainSent == 0) {
+    storeDrainStart = millis();
+    logMessage("STORE", "Uploading %u offline samples", storeCount);
+  }
+
+  for (uint8_t i = 0; i < STORE_DRAIN_BATCH && storeCount > 0; i++) {
+    storeTakeOldest();
+    uint64_t unixMs = (uint64_t)(storeBase.epoch + CLOCK_UNIX_2000 - CLOCK_UTC_OFFSET) * 1000;
+    halBlynkBeginGroup(unixMs);
+    char text[8];
+    formatFixed(text, sizeof(text), storeBase.temp, 1);
+    halBlynkWrite(V_TEMP, text);
+    formatFixed(text, sizeof(text), storeBase.humidity, 1);
+    halBlynkWrite(V_HUMIDITY, text);
+    halBlynkWrite(V_HEARTRATE, (int)storeBase.heartRate);
+    halBlynkEndGroup();
+    storeDrainSent++;
+  }
+
+  if (storeCount == 0) {
+    unsigned long elapsed = millis() - storeDrainStart;
+    logMessage("STORE", "Uploaded %u samples in %lums (%lu/s)", storeDrainSent, elapsed,
+               elapsed ? storeDrainSent * 1000UL / elapsed : storeDrainSent);
+    storeDrainSent = 0;
+  }
+}
+
+void printStoreCapacity() {
+  uint32_t bytes = sizeof(storeRing);
+  uint32_t minutes = STORE_CAPACITY * (STORE_INTERVAL / 1000) / 60;
+  Serial.printf("[STORE] %u x %uB = %uB, one sample per %lus: %uh%02um (%u min/KB)\n",
+    STORE_CAPACITY, (unsigned)sizeof(StoreRecord), bytes, STORE_INTERVAL / 1000,
+    minutes / 60, minutes % 60, minutes * 1024 / bytes);
+}
+
+void printStoreStats() {
+  Serial.printf("[PERF] store %u/%u samples, %u overwritten\n",
+    storeCount, STORE_CAPACITY, storeOverwritten);
+}
+
+// ========== DISPLAY PAGES ==========
+// The page list. Adding a page means writing its renderers and adding a
+// row to PAGES; mode switching, the Blynk mode selector and the button
+// all work from the table. STATUS_FIELDS are drawn on every page.
+void renderLinkState(char* buffer, size_t size) {
+  snprintf(buffer, size, "%s", wifiConnected ? "" : "O");
+}
+
+void renderPageNumber(char* buffer, size_t size) {
+  snprintf(buffer, size, "%d", displayMode + 1);
+}
+
+const PageField STATUS_FIELDS[] = {
+  {14, 0, 1, 500, renderLinkState},
+  {15, 0, 1, 0, renderPageNumber},
+};
+
+// Snooze time, or the next alarm, or nothing
+void renderNextAlarm(char* buffer, size_t size) {
+  if (snoozeUntil != ALARM_NONE) {
+    Time z;
+    epochToTime(snoozeUntil, z);
+    snprintf(buffer, size, "Z%02d:%02d", z.hour, z.min);
+  } else if (nextAlarmEpoch != ALARM_NONE) {
+    snprintf(buffer, size, "A%02d:%02d", alarms[nextAlarmSlot].hour, alarms[nextAlarmSlot].minute);
+  } else {
+    buffer[0] = '\0';
+  }
+}
+
+void renderTemperature(char* buffer, size_t size) {
+  uint8_t n = formatFixed(buffer, size, temperature, 1);
+  snprintf(buffer + n, size - n, "C");
+}
+
+void renderHumidity(char* buffer, size_t size) {
+  snprintf(buffer, size, "%d%%", (humidity + 5) / 10);
+}
+
+const PageLabel TIME_LABELS[] = {
+  {0, 1, "T:"},
+  {9, 1, "H:"},
+};
+
+const PageField TIME_FIELDS[] = {
+  {0, 0, 8, 500, formatTime},
+  {8, 0, 6, 1000, renderNextAlarm},
+  {2, 1, 6, 2000, renderTemperature},
+  {11, 1, 4, 2000, renderHumidity},
+};
+
+void renderIrLevel(char* buffer, size_t size) {
+  snprintf(buffer, size, "%luk", (unsigned long)(irValue / 1000));
+}
+
+void renderMuted(char* buffer, size_t size) {
+  snprintf(buffer, size, "%s", alarmMuted ? "[M]" : "");
+}
+
+void renderBpm(char* buffer, size_t size) {
+  if (irValue >= 200000) {
+    snprintf(buffer, size, "OVERLOAD!");
+  } else if (irValue <= 50000) {
+    snprintf(buffer, size, "--");
+  } else if (heartRate <= 0) {
+    snprintf(buffer, size, "Wait...");
+  } else {
+    bool warn = heartRate >= healthRules[RULE_HR_HIGH].threshold ||
+                heartRate <= healthRules[RULE_HR_LOW].threshold;
+    snprintf(buffer, size, "%d %s", heartRate, warn ? "HIGH!" : "OK");
+  }
+}
+
+// Blinks while a pulse is being read
+void renderBeatMarker(char* buffer, size_t size) {
+  bool reading = irValue > 50000 && irValue < 200000 && heartRate > 0;
+  snprintf(buffer, size, "%s", reading && (millis() / 500) % 2 == 0 ? "*" : "");
+}
+
+void toggleAlarmMute() {
+  alarmMuted = !alarmMuted;
+  
+  showOverlay("Alarm Warning:", alarmMuted ? "MUTED" : "UNMUTED", 1800);
+  
+  Serial.print("[BUTTON] Long press - Alarm ");
+  Serial.println(alarmMuted ? "MUTED" : "UNMUTED");
+  
+  // Beep pattern: 2 short beeps for mute, 1 long for unmute
+  playPattern(alarmMuted ? BEEP_DOUBLE : BEEP_LONG);
+  forceUpdate = true;
+}
+
+const PageLabel HEART_LABELS[] = {
+  {0, 0, "IR:"},
+  {0, 1, "BPM:"},
+};
+
+const PageField HEART_FIELDS[] = {
+  {3, 0, 6, 500, renderIrLevel},
+  {10, 0, 3, 500, renderMuted},
+  {4, 1, 9, 500, renderBpm},
+  {13, 1, 1, 500, renderBeatMarker},
+};
+
+void renderSummary(char* buffer, size_t size) {
+  char temp[8];
+  formatFixed(temp, sizeof(temp), temperature, 1);
+  snprintf(buffer, size, "%sC %d%% %dBPM", temp, (humidity + 5) / 10, heartRate);
+}
+
+const PageField FULL_FIELDS[] = {
+  {0, 0, 10, 1000, formatDate},
+  {0, 1, 16, 1000, renderSummary},
+};
+
+// Intervals are 300-2000 ms: RMSSD stays within 1700 and, over at least
+// HRV_MIN_INTERVALS beats, SDNN under 900, so the line fits the field's
+// 14 columns at worst ("R:1700 SD:878")
+void renderHrvTop(char* buffer, size_t size) {
+  if (hrvCount >= HRV_MIN_INTERVALS) {
+    snprintf(buffer, size, "R:%d SD:%d", hrvRmssd, hrvSdnn);
+  } else {
+    snprintf(buffer, size, "HRV: collecting");
+  }
+}
+
+void renderHrvBottom(char* buffer, size_t size) {
+  if (hrvCount >= HRV_MIN_INTERVALS) {
+    snprintf(buffer, size, "pNN50:%d%% n:%d", hrvPnn50, hrvCount);
+  } else {
+    snprintf(buffer, size, "%d/%d beats", hrvCount, HRV_MIN_INTERVALS);
+  }
+}
+
+const PageField HRV_FIELDS[] = {
+  {0, 0, 14, 1000, renderHrvTop},
+  {0, 1, 16, 1000, renderHrvBottom},
+};
+
+const PageField TREND_FIELDS[] = {
+  {0, 0, 14, 1000, renderTrendTitle},
+  {0, 1, 16, 1000, renderTrendGraph},
+};
+
+#define PAGE_ITEMS(a) a, sizeof(a) / sizeof(a[0])
+
+const DisplayPage PAGES[] = {
+  // name          labels                   fields                   prepare           longPress        holdRepeat
+  {"Time+Temp",  PAGE_ITEMS(TIME_LABELS),  PAGE_ITEMS(TIME_FIELDS),  nullptr,          nullptr,         nullptr},
+  {"Heart Rate", PAGE_ITEMS(HEART_LABELS), PAGE_ITEMS(HEART_FIELDS), nullptr,          toggleAlarmMute, nullptr},
+  {"Full Info",  nullptr, 0,               PAGE_ITEMS(FULL_FIELDS),  nullptr,          nullptr,         nullptr},
+  {"HRV",        nullptr, 0,               PAGE_ITEMS(HRV_FIELDS),   nullptr,          nullptr,         nullptr},
+  {"Trend",      nullptr, 0,               PAGE_ITEMS(TREND_FIELDS), prepareTrendPage, nullptr,         nextTrendView},
+};
+const int MODE_COUNT = sizeof(PAGES) / sizeof(PAGES[0]);
+
+// ========== BLYNK WRITE HANDLERS ==========
+BLYNK_WRITE(V_ALARM_HOUR) {
+  traceBlynkWrite(V_ALARM_HOUR, param.asInt());
+  alarms[selectedAlarm].hour = constrain(param.asInt(), 0, 23);
+  alarmsChanged();
+  logMessage("BLYNK", "Alarm %d hour: %02d", selectedAlarm + 1, alarms[selectedAlarm].hour);
+  updateStatusDisplay();
+}
+
+BLYNK_WRITE(V_ALARM_MIN) {
+  traceBlynkWrite(V_ALARM_MIN, param.asInt());
+  alarms[selectedAlarm].minute = constrain(param.asInt(), 0, 59);
+  alarmsChanged();
+  logMessage("BLYNK", "Alarm %d minute: %02d", selectedAlarm + 1, alarms[selectedAlarm].minute);
+  updateStatusDisplay();
+}
+
+BLYNK_WRITE(V_ALARM_EN) {
+  traceBlynkWrite(V_ALARM_EN, param.asInt());
+  alarms[selectedAlarm].enabled = param.asInt();
+  alarmsChanged();
+  logMessage("BLYNK", "Alarm %d %s", selectedAlarm + 1,
+    alarms[selectedAlarm].enabled ? "ENABLED" : "DISABLED");
+  if (alarmRinging && ringingAlarm == selectedAlarm && !alarms[selectedAlarm].enabled) {
+    stopAlarmSound("Auto");
+  }
+  updateStatusDisplay();
+}
+
+BLYNK_WRITE(V_STOP_ALARM) {
+  traceBlynkWrite(V_STOP_ALARM, param.asInt());
+  int buttonState = param.asInt();
+  if (buttonState == 1 && alarmRinging) {
+    stopAlarmSound("Blynk App");
+  }
+}
+
+BLYNK_WRITE(V_ALARM_SLOT) {
+  traceBlynkWrite(V_ALARM_SLOT, param.asInt());
+  int slot = param.asInt();
+  if (slot < 0 || slot >= ALARM_COUNT) {
+    logMessage("ERROR", "Invalid alarm slot %d (must be 0-%d)", slot, ALARM_COUNT - 1);
+    return;
+  }
+  selectedAlarm = slot;
+
+  // Show the selected slot's settings on the editing widgets
+  const AlarmData &a = alarms[selectedAlarm];
+  halBlynkWrite(V_ALARM_HOUR, a.hour);
+  halBlynkWrite(V_ALARM_MIN, a.minute);
+  halBlynkWrite(V_ALARM_EN, a.enabled ? 1 : 0);
+  halBlynkWrite(V_ALARM_DAYS, a.days);
+  logMessage("BLYNK", "Editing alarm %d", selectedAlarm + 1);
+}
+
+BLYNK_WRITE(V_ALARM_DAYS) {
+  traceBlynkWrite(V_ALARM_DAYS, param.asInt());
+  alarms[selectedAlarm].days = param.asInt() & ALARM_EVERY_DAY;
+  alarmsChanged();
+  logMessage("BLYNK", "Alarm %d days: 0x%02X", selectedAlarm + 1, alarms[selectedAlarm].days);
+}
+
+BLYNK_WRITE(V_RULE_SLOT) {
+  traceBlynkWrite(V_RULE_SLOT, param.asInt());
+  int rule = param.asInt();
+  if (rule < 0 || rule >= RULE_COUNT) {
+    logMessage("ERROR", "Invalid rule %d (must be 0-%d)", rule, RULE_COUNT - 1);
+    return;
+  }
+  selectedRule = rule;
+
+  // Show the selected rule's settings on the editing widgets
+  const HealthRule &r = healthRules[selectedRule];
+  halBlynkWrite(V_RULE_THRESHOLD, r.threshold);
+  halBlynkWrite(V_RULE_HYSTERESIS, r.hysteresis);
+  halBlynkWrite(V_RULE_DWELL, r.dwell);
+  halBlynkWrite(V_RULE_COOLDOWN, r.cooldown);
+  halBlynkWrite(V_RULE_ENABLED, r.enabled ? 1 : 0);
+  logMessage("BLYNK", "Editing rule %s", RULE_INFO[selectedRule].name);
+}
+
+BLYNK_WRITE(V_RULE_THRESHOLD) {
+  traceBlynkWrite(V_RULE_THRESHOLD, param.asInt());
+  healthRules[selectedRule].threshold = constrain(param.asInt(), -999, 999);
+  markConfigDirty();
+  logMessage("BLYNK", "Rule %s threshold: %d", RULE_INFO[selectedRule].name,
+    healthRules[selectedRule].threshold);
+}
+
+BLYNK_WRITE(V_RULE_HYSTERESIS) {
+  traceBlynkWrite(V_RULE_HYSTERESIS, param.asInt());
+  healthRules[selectedRule].hysteresis = constrain(param.asInt(), 0, 255);
+  markConfigDirty();
+  logMessage("BLYNK", "Rule %s hysteresis: %d", RULE_INFO[selectedRule].name,
+    healthRules[selectedRule].hysteresis);
+}
+
+BLYNK_WRITE(V_RULE_DWELL) {
+  traceBlynkWrite(V_RULE_DWELL, param.asInt());
+  healthRules[selectedRule].dwell = constrain(param.asInt(), 0, 255);
+  markConfigDirty();
+  logMessage("BLYNK", "Rule %s dwell: %ds", RULE_INFO[selectedRule].name,
+    healthRules[selectedRule].dwell);
+}
+
+BLYNK_WRITE(V_RULE_COOLDOWN) {
+  traceBlynkWrite(V_RULE_COOLDOWN, param.asInt());
+  healthRules[selectedRule].cooldown = constrain(param.asInt(), 0, 3600);
+  markConfigDirty();
+  logMessage("BLYNK", "Rule %s cooldown: %ds", RULE_INFO[selectedRule].name,
+    healthRules[selectedRule].cooldown);
+}
+
+BLYNK_WRITE(V_RULE_ENABLED) {
+  traceBlynkWrite(V_RULE_ENABLED, param.asInt());
+  healthRules[selectedRule].enabled = param.asInt();
+  markConfigDirty();
+  logMessage("BLYNK", "Rule %s %s", RULE_INFO[selectedRule].name,
+    healthRules[selectedRule].enabled ? "ENABLED" : "DISABLED");
+}
+
+BLYNK_WRITE(V_SNOOZE) {
+  traceBlynkWrite(V_SNOOZE, param.asInt());
+  if (param.asInt() == 1 && alarmRinging) {
+    snoozeAlarm("Blynk App");
+  }
+}
+
+BLYNK_WRITE(V_AUTO_MODE) {
+  traceBlynkWrite(V_AUTO_MODE, param.asInt());
+  autoModeSwitch = param.asInt();
+  logMessage("MODE", "Auto mode: %s", autoModeSwitch ? "ENABLED" : "DISABLED");
+  if (autoModeSwitch) {
+    lastModeSwitch = millis();
+  }
+  forceUpdate = true;
+}
+
+BLYNK_WRITE(V_SELECT_MODE) {
+  traceBlynkWrite(V_SELECT_MODE, param.asInt());
+  int receivedValue = param.asInt();
+  
+  Serial.printf("[BLYNK] V_SELECT_MODE received: %d\n", receivedValue);
+  
+  int newMode = receivedValue;
+  
+  if (newMode >= 0 && newMode < MODE_COUNT) {
+    displayMode = newMode;
+    if (autoModeSwitch) {
+      autoModeSwitch = false;
+      halBlynkWrite(V_AUTO_MODE, 0);
+    }
+    logMessage("MODE", "Mode set to: %d - %s", displayMode + 1, PAGES[newMode].name);
+    showModeChange();
+    forceUpdate = true;
+  } else {
+    logMessage("ERROR", "Invalid mode value %d (must be 0-%d)", receivedValue, MODE_COUNT - 1);
+  }
+}
+
+BLYNK_WRITE(V_NEXT_MODE) {
+  traceBlynkWrite(V_NEXT_MODE, param.asInt());
+  int buttonPressed = param.asInt();
+  if (buttonPressed == 1) {
+    displayMode = (displayMode + 1) % MODE_COUNT;
+    if (autoModeSwitch) {
+      autoModeSwitch = false;
+      halBlynkWrite(V_AUTO_MODE, 0);
+    }
+    halBlynkWrite(V_SELECT_MODE, displayMode);
+    logMessage("MODE", "Mode switched to: %s", PAGES[displayMode].name);
+    showModeChange();
+    playPattern(BEEP_CLICK);
+    forceUpdate = true;
+  }
+}
+
+void updateStatusDisplay() {
+  if (!wifiConnected) return;
+  
+  char status[64];
+  
+  if (alarmRinging) {
+    snprintf(status, sizeof(status), "🔴 ALARM RINGING!");
+  } else if (nextAlarmEpoch != ALARM_NONE) {
+    const AlarmData &a = alarms[nextAlarmSlot];
+    snprintf(status, sizeof(status), "🔔 Alarm: %02d:%02d | %s%s",
+      a.hour, a.minute, PAGES[displayMode].name, autoModeSwitch ? " (Auto)" : "");
+  } else {
+    snprintf(status, sizeof(status), "🟢 Online | %s%s",
+      PAGES[displayMode].name, autoModeSwitch ? " (Auto)" : "");
+  }
+  
+  publishText(TM_STATUS, status);
+}
+
+void showModeChange() {
+  char line[17];
+  const char* modeName = PAGES[displayMode].name;
+  int spaces = (16 - (int)strlen(modeName)) / 2;
+  snprintf(line, sizeof(line), "%*s%s", spaces, "", modeName);
+  showOverlay(" MODE CHANGED ", line, 1000);
+}
+
+// ========== SEND DATA TO BLYNK ==========
+void sendDataToBlynk() {
+  if (!wifiConnected) {
+    storeSample();
+    return;
+  }
+  
+  char buffer[12];
+  formatTime(buffer, sizeof(buffer));
+  publishText(TM_TIME, buffer);
+  formatDate(buffer, sizeof(buffer));
+  publishText(TM_DATE, buffer);
+  publishFixed(TM_TEMP, temperature, 1);
+  publishFixed(TM_HUMIDITY, humidity, 1);
+  publishInt(TM_HEARTRATE, fingerDetected ? heartRate : 0);
+  if (hrvCount >= HRV_MIN_INTERVALS) {
+    publishInt(TM_HRV_RMSSD, hrvRmssd);
+    publishInt(TM_HRV_SDNN, hrvSdnn);
+    publishInt(TM_HRV_PNN50, hrvPnn50);
+  }
+  char summary[48];
+  formatProfileSummary(summary, sizeof(summary));
+  publishText(TM_PROFILE, summary);
+  updateStatusDisplay();
+}
+
+// ========== UPDATE LCD DISPLAY ==========
+// A field is due when millis() has crossed a multiple of its period
+// since the previous pass
+bool fieldDue(const PageField &field, unsigned long lastPass, unsigned long now) {
+  return field.period && now / field.period != lastPass / field.period;
+}
+
+bool fieldsDue(const PageField* fields, uint8_t count, unsigned long lastPass, unsigned long now) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (fieldDue(fields[i], lastPass, now)) return true;
+  }
+  return false;
+}
+
+void drawFields(const PageField* fields, uint8_t count, bool entry, unsigned long lastPass, unsigned long now) {
+  char text[LCD_COLS + 1];
+  for (uint8_t i = 0; i < count; i++) {
+    const PageField &f = fields[i];
+    if (!entry && !fieldDue(f, lastPass, now)) continue;
+    uint32_t start = ESP.getCycleCount();
+    f.render(text, f.width + 1);
+    perfRenderCycles += ESP.getCycleCount() - start;
+    perfRenderFields++;
+    lcd.setCursor(f.col, f.row);
+    lcd.printf("%-*s", f.width, text);
+  }
+}
+
+void updateDisplay() {
+  if (updateOverlay()) return;
+  
+  if (autoModeSwitch && (millis() - lastModeSwitch >= MODE_INTERVAL)) {
+    lastModeSwitch = millis();
+    displayMode = (displayMode + 1) % MODE_COUNT;
+    forceUpdate = true;
+    
+    if (wifiConnected) {
+      halBlynkWrite(V_SELECT_MODE, displayMode);
+    }
+    
+    Serial.printf("[AUTO] Mode changed to: %d - %s\n", displayMode + 1, PAGES[displayMode].name);
+  }
+  
+  static int lastDisplayedMode = -1;
+  static unsigned long lastPass = 0;
+  
+  unsigned long now = millis();
+  const DisplayPage &page = PAGES[displayMode];
+  bool entry = forceUpdate || lastDisplayedMode != displayMode;
+  
+  if (entry) {
+    lastDisplayedMode = displayMode;
+    forceUpdate = false;
+    
+    lcd.clear();
+    for (uint8_t i = 0; i < page.labelCount; i++) {
+      lcd.setCursor(page.labels[i].col, page.labels[i].row);
+      lcd.print(page.labels[i].text);
+    }
+  }
+  
+  if (page.prepare && (entry || fieldsDue(page.fields, page.fieldCount, lastPass, now))) {
+    page.prepare();
+  }
+  drawFields(page.fields, page.fieldCount, entry, lastPass, now);
+  drawFields(STATUS_FIELDS, sizeof(STATUS_FIELDS) / sizeof(STATUS_FIELDS[0]), entry, lastPass, now);
+  lastPass = now;
+}
+
+// ========== PHYSICAL BUTTON HANDLER ==========
+// Gestures are decoded from the interrupt edge timestamps, so press
+// lengths are exact however late loop() gets to them:
+//   SHORT   released before LONG_PRESS_TIME, no second press follows
+//           within DOUBLE_PRESS_GAP
+//   DOUBLE  two short presses, the second within the gap
+//   LONG    fires once the button has been held for LONG_PRESS_TIME
+//   REPEAT  every HOLD_REPEAT_INTERVAL once held past HOLD_REPEAT_START
+// An edge within DEBOUNCE_DELAY of the last accepted one is contact
+// bounce. When that window closes the pin is read once, in case the
+// last real edge was among the ones dropped.
+enum ButtonGesture {
+  GESTURE_SHORT,
+  GESTURE_DOUBLE,
+  GESTURE_LONG,
+  GESTURE_REPEAT
+};
+
+const unsigned long LONG_PRESS_TIME = 1000;
+const unsigned long DOUBLE_PRESS_GAP = 300;
+const unsigned long HOLD_REPEAT_START = 2000;
+const unsigned long HOLD_REPEAT_INTERVAL = 250;
+
+bool buttonDown = false;
+bool buttonVerify = false;          // Re-read the pin after the debounce window
+uint32_t buttonLastEdge = 0;        // Time of the last accepted edge
+uint32_t buttonPressTime = 0;
+uint32_t buttonReleaseTime = 0;
+bool buttonLongSent = false;
+bool buttonShortPending = false;    // Short press waiting out the double gap
+uint32_t buttonNextRepeat = 0;
+
+void buttonEdge(uint32_t time, bool pressed) {
+  if (pressed == buttonDown) return;
+  buttonDown = pressed;
+  buttonLastEdge = time;
+  buttonVerify = true;
+
+  if (pressed) {
+    buttonPressTime = time;
+    buttonLongSent = false;
+    return;
+  }
+
+  if (buttonLongSent || time - buttonPressTime >= LONG_PRESS_TIME) return;
+  if (buttonShortPending) {
+    buttonShortPending = false;
+    onButtonGesture(GESTURE_DOUBLE);
+  } else {
+    buttonShortPending = true;
+    buttonReleaseTime = time;
+  }
+}
+
+void handlePhysicalButton() {
+  uint32_t time;
+  bool level;
+  while (halButtonNextEdge(time, level)) {
+    if (time - buttonLastEdge < DEBOUNCE_DELAY) continue;
+    buttonEdge(time, level == LOW);
+  }
+
+  uint32_t now = millis();
+  if (buttonVerify && now - buttonLastEdge >= DEBOUNCE_DELAY) {
+    buttonVerify = false;
+    buttonEdge(buttonLastEdge + DEBOUNCE_DELAY, halButtonRead() == LOW);
+  }
+
+  if (buttonDown) {
+    if (!buttonLongSent && now - buttonPressTime >= LONG_PRESS_TIME) {
+      if (buttonShortPending) {
+        buttonShortPending = false;
+        onButtonGesture(GESTURE_SHORT);
+      }
+      buttonLongSent = true;
+      buttonNextRepeat = buttonPressTime + HOLD_REPEAT_START;
+      onButtonGesture(GESTURE_LONG);
+    }
+    if (buttonLongSent && (int32_t)(now - buttonNextRepeat) >= 0) {
+      buttonNextRepeat += HOLD_REPEAT_INTERVAL;
+      onButtonGesture(GESTURE_REPEAT);
+    }
+  } else if (buttonShortPending && now - buttonReleaseTime > DOUBLE_PRESS_GAP) {
+    buttonShortPending = false;
+    onButtonGesture(GESTURE_SHORT);
+  }
+}
+
+void onButtonGesture(uint8_t gesture) {
+  if (alarmRinging) {
+    // Long press snoozes, any other press stops the alarm
+    if (gesture == GESTURE_LONG) {
+      snoozeAlarm("Physical Button");
+    } else if (gesture != GESTURE_REPEAT) {
+      stopAlarmSound("Physical Button");
+    }
+    return;
+  }
+
+  switch (gesture) {
+    case GESTURE_SHORT:
+      displayMode = (displayMode + 1) % MODE_COUNT;
+      
+      if (autoModeSwitch) {
+        autoModeSwitch = false;
+        if (wifiConnected) {
+          halBlynkWrite(V_AUTO_MODE, 0);
+          halBlynkWrite(V_SELECT_MODE, displayMode);
+        }
+      }
+      
+      Serial.printf("[BUTTON] Short press - Mode switched to: %d - %s\n", displayMode + 1, PAGES[displayMode].name);
+      showModeChange();
+      playPattern(BEEP_CLICK);
+      forceUpdate = true;
+      break;
+      
+    case GESTURE_DOUBLE:
+      autoModeSwitch = !autoModeSwitch;
+      if (autoModeSwitch) lastModeSwitch = millis();
+      if (wifiConnected) halBlynkWrite(V_AUTO_MODE, autoModeSwitch ? 1 : 0);
+      Serial.printf("[BUTTON] Double press - Auto mode %s\n", autoModeSwitch ? "ON" : "OFF");
+      showOverlay("Auto mode:", autoModeSwitch ? "ON" : "OFF", 1000);
+      playPattern(BEEP_DOUBLE);
+      forceUpdate = true;
+      break;
+      
+    // LONG PRESS (≥1s) and hold: the current page's actions
+    case GESTURE_LONG:
+      if (PAGES[displayMode].longPress) {
+        PAGES[displayMode].longPress();
+      } else if (!PAGES[displayMode].holdRepeat) {
+        showOverlay("Long press:", "Not on this page", 1000);
+        forceUpdate = true;
+      }
+      break;
+      
+    case GESTURE_REPEAT:
+      if (PAGES[displayMode].holdRepeat) {
+        PAGES[displayMode].holdRepeat();
+        forceUpdate = true;
+      }
+      break;
+  }
+}
+
+// ========== ALARM SCHEDULER ==========
+// The next fire instant over all enabled slots is computed once whenever
+// the table changes (or an alarm fires), so checkAlarm() is a single
+// comparison against the cached clock. Comparing with >= instead of
+// waiting for second 0 means a pass that arrives late still fires.
+
+// First time strictly after 'after' that the slot should ring
+uint32_t nextFireTime(const AlarmData &a, uint32_t after) {
+  uint32_t dayStart = after - after % 86400UL;
+  uint32_t offset = a.hour * 3600UL + a.minute * 60UL;
+
+  for (uint8_t d = 0; d <= 7; d++) {
+    uint32_t candidate = dayStart + d * 86400UL + offset;
+    if (candidate <= after) continue;
+
+    uint8_t weekday = (candidate / 86400UL + 5) % 7;  // 0 = Monday
+    if (a.days == 0 || (a.days & (1 << weekday))) return candidate;
+  }
+  return ALARM_NONE;
+}
+
+void computeNextAlarm() {
+  nextAlarmEpoch = ALARM_NONE;
+
+  for (uint8_t i = 0; i < ALARM_COUNT; i++) {
+    if (!alarms[i].enabled) continue;
+
+    uint32_t fire = nextFireTime(alarms[i], clockEpoch);
+    if (fire < nextAlarmEpoch) {
+      nextAlarmEpoch = fire;
+      nextAlarmSlot = i;
+    }
+  }
+}
+
+void alarmsChanged() {
+  markConfigDirty();
+  computeNextAlarm();
+}
+
+// The clock stepped by 'jump' seconds because the RTC was set. A snooze
+// keeps the time it had left. After a step back the cached alarm may lie
+// past one that is now due again, so the schedule is recomputed; after a
+// step forward the cached one is still the first, and checkAlarm() rings
+// it late or reports it missed.
+void alarmClockJumped(int32_t jump) {
+  if (snoozeUntil != ALARM_NONE) snoozeUntil += jump;
+  if (jump < 0) computeNextAlarm();
+}
+
+void startAlarm(uint8_t slot) {
+  stopPattern();
+  alarmRinging = true;
+  ringingAlarm = slot;
+  alarmStartTime = millis();
+  
+  showOverlay("*** ALARM! ***", "Press button!", ALARM_DURATION);
+  
+  if (wifiConnected) {
+    char msg[20];
+    snprintf(msg, sizeof(msg), "Alarm at %02d:%02d", alarms[slot].hour, alarms[slot].minute);
+    halBlynkLogEvent("alarm_event", msg);
+  }
   
-  forceUpdate = true;
-  Serial.println("[ALARM] Stopped by " + source);
+  logMessage("ALARM", "⏰ ALARM %d RINGING!", slot + 1);
+  updateStatusDisplay();
 }
 
-// ========== HEALTH WARNINGS ==========
-void checkHealthWarnings() {
-  // Check if heart rate is in danger zone
-  bool currentlyInDanger = false;
+void snoozeAlarm(const char* source) {
+  uint8_t slot = ringingAlarm;
+  stopAlarmSound(source);
+  snoozeUntil = clockEpoch + SNOOZE_DURATION;
+  ringingAlarm = slot;
+  logMessage("ALARM", "Alarm %d snoozed %d min by %s", slot + 1,
+    (int)(SNOOZE_DURATION / 60), source);
+}
+
+// ========== ALARM CONTROL ==========
+void checkAlarm() {
+  if (!alarmRinging && snoozeUntil != ALARM_NONE && clockEpoch >= snoozeUntil) {
+    snoozeUntil = ALARM_NONE;
+    startAlarm(ringingAlarm);
+  }
   
-  if (fingerDetected && heartRate > 0) {
-    if (heartRate >= HR_HIGH || heartRate <= HR_LOW) {
-      currentlyInDanger = true;
-      
-      // Start tracking if just entered danger zone
-      if (!hrInDangerZone) {
-        hrInDangerZone = true;
-        hrDangerStartTime = millis();
-        Serial.printf("[HR] Entered danger zone: %d BPM\n", heartRate);
-      }
-      
-      // Check if been in danger zone long enough
-      unsigned long timeInDanger = millis() - hrDangerStartTime;
-      
-      if (timeInDanger >= HR_DANGER_DURATION && !hrWarningActive) {
-        // Activate warning after 10 seconds
-        hrWarningActive = true;
-        
-        String msg = String("⚠️ DANGER HR: ") + String(heartRate) + " BPM for " + 
-                     String(timeInDanger/1000) + "s";
-        
-        if (wifiConnected) {
-          Blynk.virtualWrite(V_TERMINAL, 
-            String("[") + getTimeString() + "] " + msg + "\n");
-          Blynk.logEvent("health_warning", msg);
-        }
-        
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("! DANGER HR !");
-        lcd.setCursor(0, 1);
-        lcd.printf("%d BPM - %ds", heartRate, (int)(timeInDanger/1000));
-        
-        Serial.printf("[WARNING] HR danger for %d seconds: %d BPM\n", 
-                      (int)(timeInDanger/1000), heartRate);
-        
-        delay(2000);
-        forceUpdate = true;
-      }
-      
-      // Continuous beeping while in danger and not muted
-      if (hrWarningActive && !alarmMuted) {
-        if (millis() - lastHrWarningBeep >= 2000) {
-          lastHrWarningBeep = millis();
-          
-          // Beep pattern: 3 quick beeps
-          for (int i = 0; i < 3; i++) {
-            digitalWrite(BUZZER_PIN, HIGH);
-            delay(100);
-            digitalWrite(BUZZER_PIN, LOW);
-            delay(100);
-          }
-        }
-      }
-      
+  if (!alarmRinging && clockEpoch >= nextAlarmEpoch) {
+    uint8_t slot = nextAlarmSlot;
+    uint32_t late = clockEpoch - nextAlarmEpoch;
+    
+    if (alarms[slot].days == 0) {
+      // One-shot alarm: done after this
+      alarms[slot].enabled = false;
+      markConfigDirty();
+    }
+    computeNextAlarm();
+    
+    if (late <= ALARM_CATCHUP_WINDOW) {
+      snoozeUntil = ALARM_NONE;
+      startAlarm(slot);
     } else {
-      currentlyInDanger = false;
+      logMessage("ALARM", "Alarm %d missed by %u s", slot + 1, (unsigned)late);
     }
-  } else {
-    currentlyInDanger = false;
   }
   
-  // Reset if left danger zone
-  if (!currentlyInDanger && hrInDangerZone) {
-    hrInDangerZone = false;
+  if (alarmRinging) {
+    playAlarmSound();
     
-    if (hrWarningActive) {
-      hrWarningActive = false;
-      
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print("HR: Normal");
-      lcd.setCursor(0, 1);
-      lcd.printf("Was: %d BPM", heartRate);
-      
-      Serial.println("[HR] Returned to normal");
-      
-      if (wifiConnected) {
-        Blynk.virtualWrite(V_TERMINAL, 
-          String("[") + getTimeString() + "] HR returned to normal\n");
-      }
-      
-      delay(1500);
-      forceUpdate = true;
+    if (millis() - alarmStartTime > ALARM_DURATION) {
+      stopAlarmSound("Timeout");
     }
   }
+}
+
+void playAlarmSound() {
+  if (millis() - lastBuzzerToggle > (buzzerState ? 1000 : 500)) {
+    lastBuzzerToggle = millis();
+    buzzerState = !buzzerState;
+    halBuzzer(buzzerState);
+  }
+}
+
+void stopAlarmSound(const char* source) {
+  alarmRinging = false;
+  halBuzzer(false);
+  buzzerState = false;
   
-  // Temperature warning (keep original 30s cooldown)
-  static unsigned long lastTempWarning = 0;
+  char line[17];
+  snprintf(line, sizeof(line), "by %s", source);
+  showOverlay("Alarm Stopped", line, 2000);
   
-  if (temperature > TEMP_HIGH && millis() - lastTempWarning > 30000) {
-    lastTempWarning = millis();
-    
-    String msg = String("⚠️ HIGH TEMP: ") + String(temperature, 1) + "°C";
-    
-    if (wifiConnected) {
-      Blynk.virtualWrite(V_TERMINAL, 
-        String("[") + getTimeString() + "] " + msg + "\n");
-      Blynk.logEvent("health_warning", msg);
+  logMessage("ALARM", "Alarm stopped by %s", source);
+  updateStatusDisplay();
+  
+  forceUpdate = true;
+}
+
+// ========== HEALTH RULES ==========
+// Each rule compares one source (heart rate or temperature) with its
+// threshold. A reading at or past the threshold starts an episode; once
+// the episode has lasted the rule's dwell time the rule fires, then again
+// every cooldown while it lasts (cooldown 0: once per episode). The episode
+// ends when a reading is back past the threshold by the hysteresis, or the
+// source has no reading (finger off). Rules run only from healthSample(),
+// when a beat updates the heart rate, the finger comes off or a DHT
+// reading arrives, not on every loop() pass.
+struct HealthRuleState {
+  bool inside;              // Episode in progress
+  bool fired;               // Fired during this episode
+  unsigned long since;      // Episode start
+  unsigned long lastFired;
+  uint32_t triggers;        // Since boot
+  uint32_t evals;           // Since the last perf report
+  uint32_t cycles;
+};
+
+HealthRuleState ruleState[RULE_COUNT];
+unsigned long lastHrWarningBeep = 0;
+
+void healthRuleFired(uint8_t id, int value, unsigned long held) {
+  char msg[40];
+  char line[17];
+
+  if (RULE_INFO[id].source == SOURCE_HEART_RATE) {
+    snprintf(msg, sizeof(msg), "⚠️ DANGER HR: %d BPM for %ds", value, (int)(held / 1000));
+    snprintf(line, sizeof(line), "%d BPM - %ds", value, (int)(held / 1000));
+    showOverlay("! DANGER HR !", line, 2000);
+  } else {
+    char temp[8];
+    formatFixed(temp, sizeof(temp), value, 1);
+    snprintf(msg, sizeof(msg), "⚠️ HIGH TEMP: %s°C", temp);
+    snprintf(line, sizeof(line), "%sC", temp);
+    showOverlay("! HIGH TEMP !", line, 2300);
+    playPattern(BEEP_TEMP_WARNING);
+  }
+
+  if (wifiConnected) {
+    halBlynkLogEvent("health_warning", msg);
+  }
+  logMessage("WARNING", "%s", msg);
+  forceUpdate = true;
+}
+
+void healthRuleCleared(uint8_t id, int value) {
+  if (RULE_INFO[id].source != SOURCE_HEART_RATE) return;
+
+  char line[17];
+  snprintf(line, sizeof(line), "Was: %d BPM", value);
+  showOverlay("HR: Normal", line, 1500);
+  logMessage("HR", "HR returned to normal");
+  forceUpdate = true;
+}
+
+void evaluateRule(uint8_t id, bool valid, int value) {
+  const HealthRule &rule = healthRules[id];
+  HealthRuleState &state = ruleState[id];
+  bool below = RULE_INFO[id].below;
+  unsigned long now = millis();
+
+  bool past = false;
+  if (valid && rule.enabled) {
+    // Inside an episode the limit moves back by the hysteresis
+    int limit = rule.threshold;
+    if (state.inside) limit += below ? rule.hysteresis : -rule.hysteresis;
+    past = below ? value <= limit : value >= limit;
+  }
+
+  if (!past) {
+    if (state.inside) {
+      state.inside = false;
+      if (state.fired) healthRuleCleared(id, value);
+      state.fired = false;
     }
-    
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("! HIGH TEMP !");
-    lcd.setCursor(0, 1);
-    lcd.printf("%.1fC", temperature);
-    
-    for (int i = 0; i < 2; i++) {
-      digitalWrite(BUZZER_PIN, HIGH);
-      delay(150);
-      digitalWrite(BUZZER_PIN, LOW);
-      delay(150);
+    return;
+  }
+
+  if (!state.inside) {
+    state.inside = true;
+    state.since = now;
+    Serial.printf("[RULE] %s: entered at %d\n", RULE_INFO[id].name, value);
+  }
+
+  unsigned long held = now - state.since;
+  if (held < rule.dwell * 1000UL) return;
+
+  // The cooldown also spans episodes, so a reading hovering around the
+  // threshold cannot fire faster than it
+  bool due = rule.cooldown == 0
+    ? !state.fired
+    : state.triggers == 0 || now - state.lastFired >= rule.cooldown * 1000UL;
+  if (!due) return;
+
+  state.fired = true;
+  state.lastFired = now;
+  state.triggers++;
+  healthRuleFired(id, value, held);
+}
+
+// Called when the source has a new reading (or lost it)
+void healthSample(uint8_t source) {
+  bool valid;
+  int value;
+  if (source == SOURCE_HEART_RATE) {
+    valid = fingerDetected && heartRate > 0;
+    value = heartRate;
+  } else {
+    valid = true;
+    value = temperature;
+  }
+
+  for (uint8_t i = 0; i < RULE_COUNT; i++) {
+    if (RULE_INFO[i].source != source) continue;
+    uint32_t start = ESP.getCycleCount();
+    evaluateRule(i, valid, value);
+    ruleState[i].cycles += ESP.getCycleCount() - start;
+    ruleState[i].evals++;
+  }
+}
+
+// Runs every loop() pass, only to repeat the beeps of a firing HR rule
+void checkHealthWarnings() {
+  bool hrWarning = false;
+  for (uint8_t i = 0; i < RULE_COUNT; i++) {
+    if (RULE_INFO[i].source == SOURCE_HEART_RATE && ruleState[i].fired) hrWarning = true;
+  }
+
+  if (hrWarning && !alarmMuted && millis() - lastHrWarningBeep >= 2000) {
+    lastHrWarningBeep = millis();
+    playPattern(BEEP_HR_WARNING);   // 3 quick beeps
+  }
+}
+
+// Evaluations and their cost are per report window, firings since boot
+void printRuleStats() {
+  Serial.print("[PERF] rules");
+  for (uint8_t i = 0; i < RULE_COUNT; i++) {
+    HealthRuleState &state = ruleState[i];
+    Serial.printf(" %s=%u/%u(%ucyc)", RULE_INFO[i].name, state.evals, state.triggers,
+      state.evals ? state.cycles / state.evals : 0);
+    state.evals = 0;
+    state.cycles = 0;
+  }
+  Serial.println(" evals/fired");
+}
+
+void printRules() {
+  for (uint8_t i = 0; i < RULE_COUNT; i++) {
+    const HealthRule &rule = healthRules[i];
+    const HealthRuleState &state = ruleState[i];
+    Serial.printf("[RULE] %d %-9s %s %s %d hyst %u dwell %us cooldown %us, %s, fired %u\n",
+      i, RULE_INFO[i].name, rule.enabled ? "on " : "off", RULE_INFO[i].below ? "<=" : ">=",
+      rule.threshold, rule.hysteresis, rule.dwell, rule.cooldown,
+      state.fired ? "FIRING" : state.inside ? "pending" : "idle", state.triggers);
+  }
+}
+
+// ========== CONFIG JOURNAL ==========
+// The 512-byte EEPROM image is split into fixed 64-byte records that are
+// written round-robin, each carrying a sequence number and a CRC. Boot
+// scans for the valid record with the highest sequence, so a torn write
+// only loses the change in flight. Changes are marked dirty and
+// committed once they have been quiet for CONFIG_SETTLE_DELAY, so a
+// slider drag in the app costs one flash write instead of dozens.
+//
+// Record: [magic] [seq lo] [seq hi] [length] [payload ...] [crc lo] [crc hi]
+// Payload: 3 bytes per alarm slot, [enabled:1 | hour:5] [minute] [days],
+// then 7 bytes per health rule, [threshold lo] [threshold hi] [hysteresis]
+// [dwell] [cooldown lo] [cooldown hi] [enabled].
+// New fields are appended to the payload; shorter records from older
+// firmware leave the new fields at their defaults.
+#define CONFIG_RECORD_SIZE   64
+#define CONFIG_RECORD_COUNT  (EEPROM_SIZE / CONFIG_RECORD_SIZE)
+#define CONFIG_HEADER_SIZE   4
+#define CONFIG_PAYLOAD_MAX   (CONFIG_RECORD_SIZE - CONFIG_HEADER_SIZE - 2)
+#define CONFIG_MAGIC         0xC5
+#define CONFIG_ALARM_BYTES   3
+#define CONFIG_RULE_BYTES    7
+
+const unsigned long CONFIG_SETTLE_DELAY = 5000;
+
+uint16_t configSeq = 0;        // Sequence of the newest record
+uint8_t configSlot = CONFIG_RECORD_COUNT - 1;  // Slot holding it
+bool configDirty = false;
+unsigned long configDirtySince = 0;
+
+uint16_t crc16(const uint8_t* data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  while (len--) {
+    crc ^= (uint16_t)*data++ << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
     }
-    
-    delay(2000);
-    forceUpdate = true;
-    Serial.printf("[WARNING] High temp: %.1f°C\n", temperature);
   }
+  return crc;
 }
 
-// ========== EEPROM FUNCTIONS ==========
-void saveAlarm() {
-  EEPROM.write(0, alarm.hour);
-  EEPROM.write(1, alarm.minute);
-  EEPROM.write(2, alarm.enabled ? 1 : 0);
-  EEPROM.commit();
-  Serial.println("[EEPROM] Alarm saved");
+uint8_t serializeConfig(uint8_t* out) {
+  uint8_t len = 0;
+  for (uint8_t i = 0; i < ALARM_COUNT; i++) {
+    out[len++] = (alarms[i].enabled ? 0x80 : 0) | alarms[i].hour;
+    out[len++] = alarms[i].minute;
+    out[len++] = alarms[i].days;
+  }
+  for (uint8_t i = 0; i < RULE_COUNT; i++) {
+    const HealthRule &rule = healthRules[i];
+    out[len++] = rule.threshold & 0xFF;
+    out[len++] = (uint16_t)rule.threshold >> 8;
+    out[len++] = rule.hysteresis;
+    out[len++] = rule.dwell;
+    out[len++] = rule.cooldown & 0xFF;
+    out[len++] = rule.cooldown >> 8;
+    out[len++] = rule.enabled ? 1 : 0;
+  }
+  return len;
 }
 
-void loadAlarm() {
-  alarm.hour = EEPROM.read(0);
-  alarm.minute = EEPROM.read(1);
-  alarm.enabled = EEPROM.read(2) == 1;
-  
-  if (alarm.hour > 23) alarm.hour = 7;
-  if (alarm.minute > 59) alarm.minute = 0;
+void deserializeConfig(const uint8_t* in, uint8_t len) {
+  for (uint8_t i = 0; i < ALARM_COUNT && (i + 1) * CONFIG_ALARM_BYTES <= len; i++) {
+    const uint8_t* p = in + i * CONFIG_ALARM_BYTES;
+    alarms[i].enabled = p[0] & 0x80;
+    alarms[i].hour = p[0] & 0x1F;
+    alarms[i].minute = p[1];
+    alarms[i].days = p[2] & ALARM_EVERY_DAY;
+
+    if (alarms[i].hour > 23) alarms[i].hour = 7;
+    if (alarms[i].minute > 59) alarms[i].minute = 0;
+  }
+
+  const uint8_t ruleBase = ALARM_COUNT * CONFIG_ALARM_BYTES;
+  for (uint8_t i = 0; i < RULE_COUNT && ruleBase + (i + 1) * CONFIG_RULE_BYTES <= len; i++) {
+    const uint8_t* p = in + ruleBase + i * CONFIG_RULE_BYTES;
+    HealthRule &rule = healthRules[i];
+    rule.threshold = constrain((int16_t)(p[0] | (p[1] << 8)), -999, 999);
+    rule.hysteresis = p[2];
+    rule.dwell = p[3];
+    rule.cooldown = min(p[4] | (p[5] << 8), 3600);
+    rule.enabled = p[6];
+  }
+}
+
+// Reads one record into buf; returns false if the slot is not valid
+bool readConfigRecord(uint8_t slot, uint8_t* buf) {
+  int base = slot * CONFIG_RECORD_SIZE;
+  for (uint8_t i = 0; i < CONFIG_RECORD_SIZE; i++) {
+    buf[i] = halEepromRead(base + i);
+  }
+
+  uint8_t len = buf[3];
+  if (buf[0] != CONFIG_MAGIC || len > CONFIG_PAYLOAD_MAX) return false;
+
+  uint16_t stored = buf[CONFIG_HEADER_SIZE + len] | (buf[CONFIG_HEADER_SIZE + len + 1] << 8);
+  return stored == crc16(buf, CONFIG_HEADER_SIZE + len);
+}
+
+void markConfigDirty() {
+  configDirty = true;
+  configDirtySince = millis();
+}
+
+void writeConfigRecord() {
+  uint8_t buf[CONFIG_RECORD_SIZE];
+  uint8_t len = serializeConfig(buf + CONFIG_HEADER_SIZE);
+
+  configSeq++;
+  configSlot = (configSlot + 1) % CONFIG_RECORD_COUNT;
+
+  buf[0] = CONFIG_MAGIC;
+  buf[1] = configSeq & 0xFF;
+  buf[2] = configSeq >> 8;
+  buf[3] = len;
+  uint16_t crc = crc16(buf, CONFIG_HEADER_SIZE + len);
+  buf[CONFIG_HEADER_SIZE + len] = crc & 0xFF;
+  buf[CONFIG_HEADER_SIZE + len + 1] = crc >> 8;
+
+  int base = configSlot * CONFIG_RECORD_SIZE;
+  for (uint8_t i = 0; i < CONFIG_HEADER_SIZE + len + 2; i++) {
+    halEepromWrite(base + i, buf[i]);
+  }
+  halEepromCommit();
+
+  Serial.printf("[CONFIG] Saved seq %u in slot %u\n", configSeq, configSlot);
+}
+
+// Called every loop pass: commits once changes have settled
+void serviceConfig() {
+  if (configDirty && millis() - configDirtySince >= CONFIG_SETTLE_DELAY) {
+    configDirty = false;
+    writeConfigRecord();
+  }
+}
+
+void loadConfig() {
+  uint8_t buf[CONFIG_RECORD_SIZE];
+  bool found = false;
+
+  for (uint8_t slot = 0; slot < CONFIG_RECORD_COUNT; slot++) {
+    if (!readConfigRecord(slot, buf)) continue;
+
+    uint16_t seq = buf[1] | (buf[2] << 8);
+    // Sequence comparison survives the 16-bit wrap
+    if (!found || (int16_t)(seq - configSeq) > 0) {
+      found = true;
+      configSeq = seq;
+      configSlot = slot;
+    }
+  }
+
+  if (found) {
+    readConfigRecord(configSlot, buf);
+    deserializeConfig(buf + CONFIG_HEADER_SIZE, buf[3]);
+    Serial.printf("[CONFIG] Loaded seq %u from slot %u\n", configSeq, configSlot);
+  } else {
+    loadLegacyAlarms();
+    markConfigDirty();
+    Serial.println("[CONFIG] No journal, migrated legacy alarm bytes");
+  }
+}
+
+// The layout shipped before the journal: one alarm at address 0 as
+// hour, minute, enabled (1 = on). Erased flash reads 0xFF and falls back
+// to 07:00, off.
+void loadLegacyAlarms() {
+  alarms[0].hour = halEepromRead(0);
+  alarms[0].minute = halEepromRead(1);
+  alarms[0].enabled = halEepromRead(2) == 1;
+  if (alarms[0].hour > 23) alarms[0].hour = 7;
+  if (alarms[0].minute > 59) alarms[0].minute = 0;
 }
 
 // ========== WIFI MANAGEMENT ==========
-bool connectWiFi() {
-  Serial.println("\n[WIFI] Attempting connection...");
-  Serial.print("[WIFI] SSID: ");
-  Serial.println(ssid);
-  
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("WiFi connecting");
-  
+// Connection state machine, serviced from loop() and never blocking:
+//   NET_WIFI     WiFi.begin() issued, waiting for the link
+//   NET_BLYNK    link up, Blynk.run() is logging in
+//   NET_ONLINE   both up; the only state where wifiConnected is true
+//   NET_BACKOFF  an attempt failed, waiting before the next one
+// Backoff doubles from WIFI_BACKOFF_MIN up to WIFI_BACKOFF_MAX and resets
+// once online. After a full (scan + DHCP) connect, the AP's BSSID and
+// channel and the DHCP lease are kept in RTC memory, which survives
+// resets, so the next attempt connects straight to that AP with a static
+// address. If that fast attempt fails the cache is dropped and a full
+// connect follows immediately.
+enum NetState {
+  NET_WIFI,
+  NET_BLYNK,
+  NET_ONLINE,
+  NET_BACKOFF
+};
+
+const char* NET_STATE_NAMES[] = {"wifi", "blynk", "online", "backoff"};
+
+const uint32_t NET_CACHE_MAGIC = 0x4E455431;  // "NET1"
+const uint32_t NET_CACHE_RTC_BLOCK = 0;       // RTC user memory, 4-byte blocks
+
+struct NetCache {
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint16_t crc;
+  uint16_t reserved2;
+};
+
+NetCache netCache;
+uint8_t netState = NET_WIFI;
+unsigned long netStateSince = 0;
+unsigned long netBackoff = WIFI_BACKOFF_MIN;
+bool netFastAttempt = false;
+unsigned long netOfflineSince = 0;      // Start of the current outage
+unsigned long netLastTimeToOnline = 0;  // ms, last outage or boot
+uint32_t netReconnects = 0;
+
+void setNetState(uint8_t state) {
+  netState = state;
+  netStateSince = millis();
+}
+
+bool netCacheValid() {
+  return netCache.magic == NET_CACHE_MAGIC &&
+         netCache.crc == crc16((const uint8_t*)&netCache, offsetof(NetCache, crc));
+}
+
+void loadNetCache() {
+  ESP.rtcUserMemoryRead(NET_CACHE_RTC_BLOCK, (uint32_t*)&netCache, sizeof(netCache));
+  if (!netCacheValid()) netCache.magic = 0;
+}
+
+void saveNetCache() {
+  memcpy(netCache.bssid, WiFi.BSSID(), sizeof(netCache.bssid));
+  netCache.magic = NET_CACHE_MAGIC;
+  netCache.channel = WiFi.channel();
+  netCache.reserved = 0;
+  netCache.ip = WiFi.localIP();
+  netCache.gateway = WiFi.gatewayIP();
+  netCache.subnet = WiFi.subnetMask();
+  netCache.dns = WiFi.dnsIP();
+  netCache.crc = crc16((const uint8_t*)&netCache, offsetof(NetCache, crc));
+  netCache.reserved2 = 0;
+  ESP.rtcUserMemoryWrite(NET_CACHE_RTC_BLOCK, (uint32_t*)&netCache, sizeof(netCache));
+}
+
+void clearNetCache() {
+  netCache.magic = 0;
+  ESP.rtcUserMemoryWrite(NET_CACHE_RTC_BLOCK, (uint32_t*)&netCache, sizeof(netCache));
+}
+
+void startWiFiAttempt() {
+  netFastAttempt = netCacheValid();
+  if (netFastAttempt) {
+    WiFi.config(IPAddress(netCache.ip), IPAddress(netCache.gateway),
+                IPAddress(netCache.subnet), IPAddress(netCache.dns));
+    WiFi.begin(ssid, pass, netCache.channel, netCache.bssid);
+  } else {
+    WiFi.config(IPAddress(0U), IPAddress(0U), IPAddress(0U));  // Back to DHCP
+    WiFi.begin(ssid, pass);
+  }
+  Serial.printf("[WIFI] Connecting to %s (%s)\n", ssid, netFastAttempt ? "cached AP" : "scan");
+  setNetState(NET_WIFI);
+}
+
+void beginNetwork() {
+  WiFi.persistent(false);   // Credentials are in the sketch, spare the flash
   WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, pass);
-  
-  unsigned long startAttempt = millis();
-  int dotCount = 0;
-  
-  while (WiFi.status() != WL_CONNECTED && 
-         millis() - startAttempt < WIFI_TIMEOUT) {
-    delay(500);
-    Serial.print(".");
-    
-    lcd.setCursor(0, 1);
-    for (int i = 0; i < dotCount; i++) lcd.print(".");
-    dotCount = (dotCount + 1) % 16;
-    
-    if (millis() - startAttempt > WIFI_TIMEOUT / 2) {
-      WiFi.disconnect();
-      WiFi.begin(ssid, pass);
-    }
+  loadNetCache();
+  netOfflineSince = millis();
+  startWiFiAttempt();
+}
+
+void netAttemptFailed(const char* reason) {
+  if (netFastAttempt) {
+    Serial.printf("[WIFI] %s with cached AP, scanning\n", reason);
+    clearNetCache();
+    WiFi.disconnect();
+    startWiFiAttempt();
+    return;
   }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\n[WIFI] ✅ Connected!");
-    Serial.print("[IP] ");
-    Serial.println(WiFi.localIP());
-    
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("WiFi: Connected");
-    lcd.setCursor(0, 1);
-    lcd.print(WiFi.localIP());
-    delay(2000);
-    
-    return true;
+
+  Serial.printf("[WIFI] %s, retry in %lus\n", reason, netBackoff / 1000);
+  if (WiFi.status() != WL_CONNECTED) WiFi.disconnect();
+  setNetState(NET_BACKOFF);
+}
+
+void netGoOnline() {
+  wifiConnected = true;
+  netLastTimeToOnline = millis() - netOfflineSince;
+  netBackoff = WIFI_BACKOFF_MIN;
+  setNetState(NET_ONLINE);
+
+  logMessage("WIFI", "Online after %lums (%s)", netLastTimeToOnline,
+             netFastAttempt ? "cached AP" : "scan");
+  resetTelemetry();
+  IPAddress ip = WiFi.localIP();
+  char line[17];
+  snprintf(line, sizeof(line), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  showOverlay("WiFi: Online", line, 2000);
+  forceUpdate = true;
+}
+
+void netGoOffline(bool linkUp) {
+  wifiConnected = false;
+  netOfflineSince = millis();
+  netReconnects++;
+  Serial.printf("[WIFI] ❌ %s lost\n", linkUp ? "Blynk" : "WiFi");
+  showOverlay("WiFi: Offline", "Mode: Standalone", 2000);
+  forceUpdate = true;
+
+  // Blynk.run() logs back in by itself; a dropped link needs a new attempt
+  if (linkUp) {
+    setNetState(NET_BLYNK);
   } else {
-    Serial.println("\n[WIFI] ❌ Connection failed!");
-    Serial.println("[WIFI] Continuing in OFFLINE mode");
-    
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("WiFi: OFFLINE");
-    lcd.setCursor(0, 1);
-    lcd.print("Mode: Standalone");
-    delay(3000);
-    
-    return false;
+    startWiFiAttempt();
   }
 }
 
-void checkWiFiStatus() {
-  if (millis() - lastWiFiCheck < WIFI_CHECK_INTERVAL) return;
-  lastWiFiCheck = millis();
-  
-  bool currentStatus = (WiFi.status() == WL_CONNECTED);
-  
-  if (currentStatus != wifiConnected) {
-    wifiConnected = currentStatus;
-    
-    if (wifiConnected) {
-      Serial.println("[WIFI] ✅ Reconnected!");
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print("WiFi: Online");
-      lcd.setCursor(0, 1);
-      lcd.print(WiFi.localIP());
-      delay(2000);
-      forceUpdate = true;
-    } else {
-      Serial.println("[WIFI] ❌ Disconnected!");
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print("WiFi: Offline");
-      lcd.setCursor(0, 1);
-      lcd.print("Mode: Standalone");
-      delay(2000);
-      forceUpdate = true;
+// True while Blynk.run() should be called
+bool netLinkUp() {
+  return netState == NET_BLYNK || netState == NET_ONLINE;
+}
+
+void serviceNetwork() {
+  unsigned long inState = millis() - netStateSince;
+  bool linkUp = WiFi.status() == WL_CONNECTED;
+
+  switch (netState) {
+    case NET_WIFI:
+      if (linkUp) {
+        if (!netFastAttempt) saveNetCache();
+        Serial.printf("[WIFI] ✅ Link up after %lums\n", millis() - netOfflineSince);
+        setNetState(NET_BLYNK);
+      } else if (inState > WIFI_TIMEOUT) {
+        netAttemptFailed("WiFi timeout");
+      }
+      break;
+
+    case NET_BLYNK:
+      if (!linkUp) {
+        startWiFiAttempt();
+      } else if (Blynk.connected()) {
+        netGoOnline();
+      } else if (inState > BLYNK_LOGIN_TIMEOUT) {
+        // No Blynk.disconnect(): that parks the client until connect() is
+        // called again. Blynk.run() is not called during the backoff, so
+        // the login just resumes when NET_BLYNK comes round again.
+        netFastAttempt = false;   // The link itself worked
+        netAttemptFailed("Blynk login timeout");
+      }
+      break;
+
+    case NET_ONLINE:
+      if (!linkUp || !Blynk.connected()) netGoOffline(linkUp);
+      break;
+
+    case NET_BACKOFF:
+      if (inState < netBackoff) break;
+      netBackoff = min(netBackoff * 2, WIFI_BACKOFF_MAX);
+      if (linkUp) {
+        setNetState(NET_BLYNK);
+      } else {
+        startWiFiAttempt();
+      }
+      break;
+  }
+}
+
+void printNetStats() {
+  Serial.printf("[PERF] net %s rssi=%d online-after=%lums reconnects=%u\n",
+    NET_STATE_NAMES[netState], WiFi.RSSI(), netLastTimeToOnline, netReconnects);
+}
+
+// ========== SERIAL COMMANDS ==========
+// Line-based commands on the USB serial port:
+//   prof          print the stage profile
+//   prof reset    clear it
+//   stall <us>    set the stall threshold
+//   lcdbench      time LCD updates with both backends
+//   rules         print the health rules and their state
+// The port carries trace frames in TRACE_REPLAY builds, so it is not
+// read there.
+char serialLine[32];
+uint8_t serialLen = 0;
+
+void runSerialCommand(char* line) {
+  if (strcmp(line, "prof") == 0) {
+    printProfile();
+  } else if (strcmp(line, "prof reset") == 0) {
+    resetProfile();
+    Serial.println("[PROF] Reset");
+  } else if (strncmp(line, "stall ", 6) == 0) {
+    profileStallUs = strtoul(line + 6, NULL, 10);
+    Serial.printf("[PROF] Stall threshold %uus\n", profileStallUs);
+  } else if (strcmp(line, "lcdbench") == 0) {
+    benchLcd();
+  } else if (strcmp(line, "rules") == 0) {
+    printRules();
+  } else if (line[0]) {
+    Serial.printf("[CMD] Unknown command: %s\n", line);
+  }
+}
+
+void serviceSerial() {
+#ifndef TRACE_REPLAY
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == '\r') continue;
+    if (c == '\n') {
+      serialLine[serialLen] = '\0';
+      runSerialCommand(serialLine);
+      serialLen = 0;
+    } else if (serialLen < sizeof(serialLine) - 1) {
+      serialLine[serialLen++] = c;
     }
   }
+#endif
 }
 
 // ========== SETUP ==========
+// Startup runs in phases, cheapest path to a useful screen first:
+//   clock    RTC, LCD and saved alarms, then the time page is drawn
+//   sensors  DHT11, MAX30102, button
+//   network  Blynk/timer setup; the connection itself runs from loop()
+// Nothing here waits on a delay, so the time is on screen as soon as the
+// LCD has initialised. Each phase logs its duration.
+const unsigned long BOOT_FIRST_FRAME_TARGET = 100;  // ms since power-on
+
+unsigned long bootPhaseStart = 0;
+
+void bootPhaseDone(const char* phase) {
+  unsigned long now = millis();
+  Serial.printf("[BOOT] %-8s %4lums (t=%lums)\n", phase, now - bootPhaseStart, now);
+  bootPhaseStart = now;
+}
+
 void setup() {
+#if defined(TRACE_RECORD) || defined(TRACE_REPLAY)
+  Serial.setRxBufferSize(1024);
+  Serial.begin(TRACE_BAUD);
+#else
   Serial.begin(115200);
-  delay(100);
+#endif
+  traceBegin();
+#ifdef TRACE_REPLAY
+  replayBootMillis = millis();
+#endif
+  bootPhaseStart = millis();
   
   Serial.println("\n╔═══════════════════════════════════════╗");
   Serial.println("║   SMART CLOCK - VERSION 4.4 FIXED    ║");
   Serial.println("║   Button & Health Warning Fixed      ║");
   Serial.println("╚═══════════════════════════════════════╝\n");
   
+  Serial.printf("[BOOT] sketch %uB\n", ESP.getSketchSize());
+  
+  // ----- Phase 1: clock on screen -----
   pinMode(BUZZER_PIN, OUTPUT);
-  pinMode(BUTTON_PIN, INPUT_PULLUP);
-  digitalWrite(BUZZER_PIN, LOW);
+  halButtonInit();
+  halBuzzer(false);
   
   Wire.begin(D2, D1);
-  Serial.println("[I2C] Initialized: SDA=D2, SCL=D1");
+  Wire.setClock(I2C_CLOCK);
   
-  Serial.print("[DS1302] Init... ");
-  rtc.halt(false);
-  rtc.writeProtect(false);
-  Time t = rtc.getTime();
-  Serial.println("OK");
+  halRtcInit();
+  clockTick();
+  const Time &t = clockNow();
   Serial.printf("[DS1302] %02d/%02d/%04d %02d:%02d:%02d\n",
     t.date, t.mon, t.year, t.hour, t.min, t.sec);
   
-  Serial.print("[LCD] Init... ");
   lcd.init();
   lcd.backlight();
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(" SMART CLOCK ");
-  lcd.setCursor(0, 1);
-  lcd.print("  v4.4 FIXED  ");
-  Serial.println("OK");
-  delay(2000);
   
-  Serial.print("[DHT11] Init... ");
-  dht.begin();
-  Serial.println("OK");
+  halEepromBegin();
+  loadConfig();
+  computeNextAlarm();
+  resetRollups();
   
-  Serial.print("[MAX30102] Init... ");
-  if (!particleSensor.begin(Wire, I2C_SPEED_STANDARD)) {
-    Serial.println("FAILED!");
-    lcd.clear();
-    lcd.print("MAX30102 ERROR!");
-    delay(2000);
-  } else {
-    Serial.println("OK");
-    particleSensor.setup();
-    particleSensor.setPulseAmplitudeRed(0x0A);
-    particleSensor.setPulseAmplitudeGreen(0);
-    Serial.println("[MAX30102] LED: Red=0x0A, Green=OFF");
+  forceUpdate = true;
+  updateDisplay();
+  lcd.flush();
+  unsigned long firstFrame = millis();
+  bootPhaseDone("clock");
+  if (firstFrame > BOOT_FIRST_FRAME_TARGET) {
+    Serial.printf("[BOOT] ⚠️ First frame at %lums, target %lums\n",
+      firstFrame, BOOT_FIRST_FRAME_TARGET);
   }
   
-  EEPROM.begin(512);
-  loadAlarm();
-  Serial.printf("[ALARM] Loaded: %02d:%02d (%s)\n", 
-    alarm.hour, alarm.minute, alarm.enabled ? "ON" : "OFF");
-  
-  Serial.print("[BUTTON] Testing... ");
-  Serial.println(digitalRead(BUTTON_PIN) == HIGH ? "OK" : "PRESSED");
-  
-  wifiConnected = connectWiFi();
-  
-  if (wifiConnected) {
-    Serial.println("[BLYNK] Connecting...");
-    Blynk.config(BLYNK_AUTH_TOKEN);
-    
-    if (Blynk.connect(3000)) {
-      Serial.println("[BLYNK] ✅ Connected!");
-      Blynk.virtualWrite(V_TERMINAL, 
-        String("[") + getTimeString() + "] System started (Online Mode)\n");
-      
-      timer.setInterval(2000L, readSensors);
-      timer.setInterval(3000L, sendDataToBlynk);
-    } else {
-      Serial.println("[BLYNK] ❌ Connection failed!");
-      wifiConnected = false;
-    }
+  for (uint8_t i = 0; i < ALARM_COUNT; i++) {
+    Serial.printf("[ALARM] Loaded %d: %02d:%02d days=0x%02X (%s)\n", i + 1,
+      alarms[i].hour, alarms[i].minute, alarms[i].days, alarms[i].enabled ? "ON" : "OFF");
   }
   
-  digitalWrite(BUZZER_PIN, HIGH);
-  delay(100);
-  digitalWrite(BUZZER_PIN, LOW);
-  delay(100);
-  digitalWrite(BUZZER_PIN, HIGH);
-  delay(100);
-  digitalWrite(BUZZER_PIN, LOW);
+  // ----- Phase 2: sensors -----
+  halDhtInit();
+  readSensors();   // First result arrives a few loop() passes later
   
-  if (wifiConnected) {
-    Serial.println("\n[SYSTEM] Ready! Mode: ONLINE ✅");
+  if (!halIrInit()) {
+    Serial.println("[MAX30102] FAILED!");
+    showOverlay("MAX30102 ERROR!", "", 2000);
   } else {
-    Serial.println("\n[SYSTEM] Ready! Mode: OFFLINE (Standalone) 🔴");
-    Serial.println("[INFO] All sensors working independently");
-    Serial.println("[INFO] Short press: Switch mode | Long press (Mode 2): Mute");
+    Serial.println("[MAX30102] OK, LED: Red=0x0A, Green=OFF");
   }
   
-  lcd.clear();
+  Serial.print("[BUTTON] ");
+  Serial.println(halButtonRead() == HIGH ? "OK" : "PRESSED");
+  bootPhaseDone("sensors");
+  
+  // ----- Phase 3: network -----
+  // Sensors and telemetry run from the timer whether online or not;
+  // sendDataToBlynk() skips itself while offline
+#ifdef BLYNK_LOCAL_SERVER
+  Blynk.config(BLYNK_AUTH_TOKEN, BLYNK_LOCAL_SERVER, BLYNK_LOCAL_PORT);
+#else
+  Blynk.config(BLYNK_AUTH_TOKEN);
+#endif
+  timer.setInterval(2000L, readSensors);
+  timer.setInterval(TELEMETRY_CHECK_INTERVAL, sendDataToBlynk);
+  beginNetwork();
+  printStoreCapacity();
+  bootPhaseDone("network");
+  
+  playPattern(BEEP_DOUBLE);
+  
+  Serial.println("\n[SYSTEM] Ready! WiFi/Blynk connect in the background");
+  Serial.println("[INFO] Short press: Switch mode | Long press (Mode 2): Mute");
+  
+  perfWindowStart = millis();
+  resetProfile();
 }
 
 // ========== MAIN LOOP ==========
 void loop() {
-  if (wifiConnected) {
+  uint32_t loopStart = micros();
+  
+#ifdef TRACE_REPLAY
+  replayPoll();
+#endif
+  uint32_t mark = ESP.getCycleCount();
+  clockTick();
+  mark = profileStage(STAGE_CLOCK, mark);
+  
+  if (netLinkUp()) {
     Blynk.run();
-    timer.run();
-    checkWiFiStatus();
-  } else {
-    if (millis() - lastSensorRead > SENSOR_READ_INTERVAL) {
-      lastSensorRead = millis();
-      readSensors();
-    }
-    checkWiFiStatus();
+    mark = profileStage(STAGE_BLYNK, mark);
   }
+  timer.run();
+  mark = profileStage(STAGE_TIMER, mark);
+  pollSensors();
+  mark = profileStage(STAGE_SENSORS, mark);
+  serviceNetwork();
+  mark = profileStage(STAGE_WIFI, mark);
+  serviceStore();
+  mark = profileStage(STAGE_STORE, mark);
   
   readHeartRate();
+  mark = profileStage(STAGE_HEART, mark);
   checkAlarm();
-  checkHealthWarnings(); // Check health warnings continuously
+  mark = profileStage(STAGE_ALARM, mark);
+  checkHealthWarnings(); // Repeat HR warning beeps (rules run in healthSample())
+  mark = profileStage(STAGE_HEALTH, mark);
   handlePhysicalButton();
+  mark = profileStage(STAGE_BUTTON, mark);
+  updateBuzzer();
+  mark = profileStage(STAGE_BUZZER, mark);
   updateDisplay();
+  lcd.flush();
+  mark = profileStage(STAGE_DISPLAY, mark);
+  flushTerminal();
+  mark = profileStage(STAGE_TERMINAL, mark);
+  serviceConfig();
+  profileStage(STAGE_CONFIG, mark);
+  profileLoops++;
+  
+  serviceSerial();
+  recordLoopTime(micros() - loopStart);
+  reportPerf();
 }
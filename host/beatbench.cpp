@@ -0,0 +1,268 @@
+// Beat detection benchmark: feeds a labelled PPG trace (see traces/)
+// through the sketch's processPpgSample() and through the checkForBeat()
+// loop the sketch used before, and reports for each the cost per sample
+// and the rate error against the labels.
+//
+//   build/beatbench [--max-error BPM] traces/rest.trace
+//
+// The rate shown is sampled once per labelled second, from 5 s after the
+// finger goes on (both detectors need a few beats first). Error is the
+// mean absolute difference to the label over the seconds with a reading;
+// coverage is the share of seconds that had one. Cycles are host CPU
+// cycles (the TSC on x86, else nanoseconds), so compare the two rows
+// rather than reading them as ESP8266 figures; on the device PERF prints
+// ppg cycles/sample for whichever detector is built in. With --max-error
+// the exit code is 1 when the sketch's pipeline misses the bound or does
+// worse than checkForBeat().
+//
+// The sketch is compiled into this file so its globals are at hand.
+#include "sketch.cpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+
+const unsigned long SAMPLE_MS = 10;      // 100 Hz, as the sketch sets it up
+const unsigned long SETTLE_MS = 5000;
+const int TIMING_PASSES = 20;
+
+struct Label {
+  unsigned long time;
+  double bpm;
+};
+
+struct Result {
+  double cycles;       // Per sample, best of TIMING_PASSES
+  double error;        // Mean absolute, BPM
+  double worst;
+  int covered;
+  int scored;
+};
+
+uint64_t hostCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+std::vector<PpgSample> loadTrace(const std::string &path) {
+  std::vector<PpgSample> samples;
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    fprintf(stderr, "beatbench: cannot open %s\n", path.c_str());
+    exit(2);
+  }
+  std::vector<uint8_t> data;
+  int c;
+  while ((c = fgetc(f)) != EOF) data.push_back(c);
+  fclose(f);
+
+  // Same framing as sim::loadPpgTrace(); PPG payload is red then IR
+  size_t i = 0;
+  while (i + 8 <= data.size()) {
+    uint8_t len = data[i + 2];
+    if (data[i] != 0xA5 || i + 8 + len > data.size()) {
+      i++;
+      continue;
+    }
+    uint8_t crc = 0;
+    for (size_t k = i + 1; k < i + 7 + len; k++) {
+      crc ^= data[k];
+      for (uint8_t b = 0; b < 8; b++) crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    if (crc != data[i + 7 + len]) {
+      i++;
+      continue;
+    }
+    const uint8_t* p = &data[i + 7];
+    if (data[i + 1] == 1) {
+      for (uint8_t s = 0; s < p[0] && 1 + s * 6 + 6 <= len; s++) {
+        const uint8_t* q = p + 1 + s * 6;
+        PpgSample sample;
+        sample.time = (samples.size() + 1) * SAMPLE_MS;
+        sample.red = q[0] | q[1] << 8 | q[2] << 16;
+        sample.ir = q[3] | q[4] << 8 | q[5] << 16;
+        samples.push_back(sample);
+      }
+    }
+    i += 8 + len;
+  }
+  return samples;
+}
+
+std::vector<Label> loadLabels(const std::string &path) {
+  std::vector<Label> labels;
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    fprintf(stderr, "beatbench: cannot open %s\n", path.c_str());
+    exit(2);
+  }
+  char line[64];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long time;
+    double bpm;
+    if (line[0] != '#' && sscanf(line, "%lu %lf", &time, &bpm) == 2) labels.push_back({time, bpm});
+  }
+  fclose(f);
+  return labels;
+}
+
+// ----- The sketch's pipeline, driven like readHeartRate() -----
+void pipelineReset() {
+  resetBeatDetector();
+  fingerDetected = false;
+  lastFingerRemoved = 0;
+}
+
+int pipelineSample(const PpgSample &sample) {
+  processPpgSample(sample);
+  if (!fingerDetected && sample.time - lastFingerRemoved > 2000 && lastBeat != 0) {
+    resetBeatDetector();
+  }
+  return heartRate;
+}
+
+// ----- The loop the sketch used before: checkForBeat(), average of 4 -----
+const uint8_t RATE_SIZE = 4;
+uint8_t legacyRates[RATE_SIZE];
+uint8_t legacySpot = 0;
+unsigned long legacyLastBeat = 0;
+unsigned long legacyFingerRemoved = 0;
+bool legacyFinger = false;
+int legacyRate = 0;
+
+void legacyReset() {
+  memset(legacyRates, 0, sizeof(legacyRates));
+  legacySpot = 0;
+  legacyLastBeat = 0;
+  legacyFingerRemoved = 0;
+  legacyFinger = false;
+  legacyRate = 0;
+}
+
+int legacySample(const PpgSample &sample) {
+  if (sample.ir > 50000 && sample.ir < 200000) {
+    legacyFinger = true;
+  } else {
+    if (legacyFinger) legacyFingerRemoved = sample.time;
+    legacyFinger = false;
+  }
+
+  if (legacyFinger && checkForBeat(sample.ir)) {
+    long delta = sample.time - legacyLastBeat;
+    legacyLastBeat = sample.time;
+    float bpm = 60.0 / (delta / 1000.0);
+    if (bpm > 20 && bpm < 200) {
+      legacyRates[legacySpot++] = (uint8_t)bpm;
+      legacySpot %= RATE_SIZE;
+      legacyRate = 0;
+      for (uint8_t i = 0; i < RATE_SIZE; i++) legacyRate += legacyRates[i];
+      legacyRate /= RATE_SIZE;
+    }
+  }
+
+  if (!legacyFinger && sample.time - legacyFingerRemoved > 2000) {
+    legacyRate = 0;
+    memset(legacyRates, 0, sizeof(legacyRates));
+  }
+  return legacyRate;
+}
+
+// checkForBeat() keeps its filter state in the library with no way to
+// reset it, so the scored pass runs first, on a fresh process
+Result measure(const std::vector<PpgSample> &samples, const std::vector<Label> &labels,
+               void (*reset)(), int (*process)(const PpgSample &)) {
+  Result r = {0, 0, 0, 0, 0};
+
+  reset();
+  size_t next = 0;
+  unsigned long fingerOn = 0;
+  double previous = 0;
+  double total = 0;
+  for (const PpgSample &sample : samples) {
+    int rate = process(sample);
+    while (next < labels.size() && labels[next].time <= sample.time) {
+      const Label &label = labels[next++];
+      if (label.bpm > 0 && previous == 0) fingerOn = label.time;
+      previous = label.bpm;
+      if (label.bpm == 0 || label.time < fingerOn + SETTLE_MS) continue;
+      r.scored++;
+      if (rate == 0) continue;
+      double error = fabs(rate - label.bpm);
+      total += error;
+      if (error > r.worst) r.worst = error;
+      r.covered++;
+    }
+  }
+  r.error = r.covered ? total / r.covered : 0;
+
+  r.cycles = 1e9;
+  for (int pass = 0; pass < TIMING_PASSES; pass++) {
+    reset();
+    uint64_t start = hostCycles();
+    for (const PpgSample &sample : samples) process(sample);
+    double cycles = (double)(hostCycles() - start) / samples.size();
+    if (cycles < r.cycles) r.cycles = cycles;
+  }
+  return r;
+}
+
+void report(const char* name, const Result &r) {
+  printf("[BENCH] %-12s %5.1f cycles/sample, error %4.1f BPM (worst %4.1f), coverage %d/%d s\n",
+    name, r.cycles, r.error, r.worst, r.covered, r.scored);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double maxError = 0;
+  std::string trace;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--max-error") == 0 && i + 1 < argc) {
+      maxError = atof(argv[++i]);
+    } else if (argv[i][0] != '-' && trace.empty()) {
+      trace = argv[i];
+    } else {
+      fprintf(stderr, "usage: beatbench [--max-error BPM] TRACE  (labels in TRACE minus .trace plus .labels)\n");
+      return 2;
+    }
+  }
+  if (trace.empty()) {
+    fprintf(stderr, "usage: beatbench [--max-error BPM] TRACE\n");
+    return 2;
+  }
+
+  std::string base = trace.substr(0, trace.rfind(".trace"));
+  std::vector<PpgSample> samples = loadTrace(trace);
+  std::vector<Label> labels = loadLabels(base + ".labels");
+  if (samples.empty() || labels.empty()) {
+    fprintf(stderr, "beatbench: no samples or labels for %s\n", trace.c_str());
+    return 2;
+  }
+
+  // Warnings would print from inside the pipeline; only the rate matters
+  for (uint8_t i = 0; i < RULE_COUNT; i++) healthRules[i].enabled = false;
+
+  printf("[BENCH] %s: %zu samples, %zu labels\n", trace.c_str(), samples.size(), labels.size());
+  Result legacy = measure(samples, labels, legacyReset, legacySample);
+  Result pipeline = measure(samples, labels, pipelineReset, pipelineSample);
+  report("pipeline", pipeline);
+  report("checkForBeat", legacy);
+
+  if (maxError > 0) {
+    bool ok = pipeline.covered > 0 && pipeline.error <= maxError &&
+              pipeline.covered >= legacy.covered &&
+              (legacy.covered == 0 || pipeline.error <= legacy.error);
+    printf("[BENCH] %s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : 1;
+  }
+  return 0;
+}
@@ -0,0 +1,214 @@
+#!/bin/bash
+# Scenario checks for the host build: runs the sketch against the
+# simulated board and greps its output. Usage: check.sh BUILD_DIR
+set -u
+BUILD=${1:-build}
+OUT=$BUILD/check
+mkdir -p "$OUT"
+FAILED=0
+
+# run NAME BINARY ARGS... : output in $OUT/NAME.log, exit code kept
+run() {
+  local name=$1
+  shift
+  "$@" > "$OUT/$name.log" 2>&1 < /dev/null
+  echo $? > "$OUT/$name.status"
+}
+
+# expect NAME PATTERN DESCRIPTION : the log must match the regex
+expect() {
+  if grep -aqE "$2" "$OUT/$1.log"; then
+    echo "ok    $1: $3"
+  else
+    echo "FAIL  $1: $3 (no match for '$2' in $OUT/$1.log)"
+    FAILED=1
+  fi
+}
+
+# refuse NAME PATTERN DESCRIPTION : the log must not match the regex
+refuse() {
+  if grep -aqE "$2" "$OUT/$1.log"; then
+    echo "FAIL  $1: $3 ($(grep -aE "$2" "$OUT/$1.log" | head -1))"
+    FAILED=1
+  else
+    echo "ok    $1: $3"
+  fi
+}
+
+# count NAME PATTERN N DESCRIPTION : exactly N lines match
+count() {
+  local n
+  n=$(grep -acE "$2" "$OUT/$1.log")
+  if [ "$n" = "$3" ]; then
+    echo "ok    $1: $4"
+  else
+    echo "FAIL  $1: $4 ($n lines match '$2', expected $3)"
+    FAILED=1
+  fi
+}
+
+# exits NAME CODE DESCRIPTION
+exits() {
+  if [ "$(cat "$OUT/$1.status")" = "$2" ]; then
+    echo "ok    $1: $3"
+  else
+    echo "FAIL  $1: $3 (exit $(cat "$OUT/$1.status"))"
+    FAILED=1
+  fi
+}
+
+# ----- A minute on the bench: finger on, button, app write -----
+run smoke "$BUILD/clock" --seconds 60 --finger 5-35@72 --press 40 --app 45:5:7
+exits smoke 0 "runs to the end"
+expect smoke '^\[PERF\] loops=' "perf report"
+expect smoke 'hr 7[0-4] ' "heart rate near 72 BPM"
+expect smoke 'wifi 1 attempts, 1 connects' "WiFi up on the first attempt"
+expect smoke 'blynk connected' "Blynk online"
+expect smoke 'lcd [0-9]+ instructions, 0 lost' "no LCD instruction lost"
+expect smoke 'i2c 100 kHz' "bus at the PCF8574's rated 100 kHz"
+# Live telemetry is not grouped: outside windows that upload the offline
+# backlog (the only grouped sends), Blynk frames never exceed writes
+if awk '/\[STORE\] Uploading/ { backlog = 1 }
+        match($0, /blynk=[0-9]+w\/[0-9]+f/) {
+          split(substr($0, RSTART + 6, RLENGTH - 7), n, "w/")
+          if (!backlog && n[2] + 0 > n[1] + 0) bad = 1
+          backlog = 0
+        }
+        END { exit bad }' "$OUT/smoke.log"; then
+  echo "ok    smoke: live telemetry sends no more frames than writes"
+else
+  echo "FAIL  smoke: live telemetry sends no more frames than writes ($(grep -a 'blynk=' "$OUT/smoke.log" | head -3 | tr '\n' ' '))"
+  FAILED=1
+fi
+expect smoke 'max30102 [0-9]+ samples, 0 overflowed' "PPG FIFO never overflows"
+expect smoke '\[BUTTON\] Short press' "button press seen"
+
+# ----- Five app writes in one pass: a burst of terminal lines -----
+run terminal "$BUILD/clock" --seconds 25 --app 20:14:1 --app 20:5:6 --app 20:6:30 --app 20:7:1 --app 20:15:31
+expect terminal 'Alarm 2 days: 0x1F' "all writes handled"
+expect terminal '0 values too long' "terminal batches fit in BLYNK_MAX_SENDBYTES"
+
+# ----- RTC set back 15 min while an alarm is snoozed -----
+# Alarm 1 at 08:05 rings at 300 s and is snoozed. The RTC is set back at
+# 310 s and the clock picks that up at the 600 s resync (07:55): the
+# snooze still ends 5 s later, and 08:05 comes round again at 1200 s.
+run rtcjump "$BUILD/clock" --seconds 1300 --step-us 1000 --app 5:5:8 --app 5:6:5 --app 5:7:1 \
+  --app 305:16:1 --rtc-step 310:-900
+expect rtcjump 'Resync: predicted \+900 s' "step back detected"
+count rtcjump 'ALARM 1 RINGING' 3 "rings, snooze and the repeated 08:05"
+
+# ----- EEPROM from the pre-journal firmware: 06:30, enabled -----
+{ printf '\x06\x1e\x01'; head -c 509 /dev/zero | tr '\0' '\377'; } > "$OUT/legacy.eeprom"
+run legacy "$BUILD/clock" --seconds 8 --eeprom "$OUT/legacy.eeprom"
+run legacy2 "$BUILD/clock" --seconds 1 --eeprom "$OUT/legacy.eeprom"
+expect legacy 'migrated legacy alarm bytes' "legacy layout detected"
+expect legacy 'Loaded 1: 06:30 days=0x7F \(ON\)' "alarm 1 migrated"
+expect legacy2 'Loaded seq 1 from slot 0' "journal written"
+expect legacy2 'Loaded 1: 06:30 days=0x7F \(ON\)' "alarm 1 kept after reboot"
+
+# ----- Beat detection against the labelled traces -----
+# Rate within 3 BPM on average, and no worse than checkForBeat()
+for trace in traces/*.trace; do
+  name=beat-$(basename "$trace" .trace)
+  run "$name" "$BUILD/beatbench" --max-error 3 "$trace"
+  exits "$name" 0 "$(grep -a '^\[BENCH\] pipeline' "$OUT/$name.log" | cut -c 9-)"
+done
+
+# ----- Display formatting: fixed point against the float printf it replaced -----
+run fmt "$BUILD/fmtbench"
+exits fmt 0 "same text for every reading"
+expect fmt '^\[BENCH\] fixed +[0-9.]+ cycles/refresh' "fixed-point cost per refresh"
+expect fmt '^\[BENCH\] float +[0-9.]+ cycles/refresh' "float cost per refresh"
+
+# ----- Blynk server ignores logins for the first 30 s -----
+run blynkmute "$BUILD/clock" --seconds 90 --blynk-mute 0-30
+expect blynkmute 'Blynk login timeout, retry in' "login timeout backs off"
+expect blynkmute '\[WIFI\] Online after' "back online once the server answers"
+expect blynkmute 'blynk connected, .* 1 logins' "client still logging in after the timeout"
+
+# ----- Boot: the time is on screen within 100 ms of power-on -----
+run boot "$BUILD/clock" --seconds 1
+expect boot 'first text at [0-9]{1,2}\.[0-9] ms' "LCD shows text within 100 ms"
+expect boot '^\[BOOT\] clock +[0-9]+ms \(t=[0-9]{1,2}ms\)' "clock phase done within 100 ms"
+refuse boot 'First frame at' "no first-frame warning"
+refuse boot 'lcd [0-9]+ instructions, [1-9]' "no LCD instruction lost during init"
+
+# ----- Seven days on the simulated board, through the millis() wrap -----
+run soak "$BUILD/soak"
+exits soak 0 "soak run passes"
+expect soak '^\[SOAK\] PASSED' "all soak checks pass"
+refuse soak '^\[SOAK\] FAIL' "no failed check"
+count soak '^\[SOAK\] day [0-9]+:' 8 "a report per calendar day"
+expect soak '^\[SOAK\] 13 rings, [0-9]+ temp warnings' "every alarm rang on its days"
+expect soak '^\[SOAK\] 7 days in [0-9.]+s host, [0-9]{5,}x speedup' "a week at 10000x real time or better"
+
+# ----- Above 35.0 C: temp_high keeps the old strictly-greater check -----
+printf '0 35.0 50\n10 35.1 50\n' > "$OUT/temp.dht"
+run temp "$BUILD/clock" --seconds 20 --dht "$OUT/temp.dht"
+refuse temp 'HIGH TEMP: 35\.0' "no warning at exactly 35.0 C"
+count temp 'HIGH TEMP: 35\.1' 1 "fires once at 35.1 C"
+
+# ----- Below -10 C: the trend title still fits its 14 columns -----
+printf '0 -12.0 40\n60 -8.0 40\n120 -5.0 40\n' > "$OUT/cold.dht"
+run cold "$BUILD/clock" --seconds 200 --dht "$OUT/cold.dht" --app 150:12:4 --lcd
+expect cold 'lcd \|T40m -12--5\.0 ' "minimum in whole degrees, range complete"
+refuse cold 'lcd \|T(40m|10h) -12\.' "no decimal that would push the maximum off"
+
+# ----- Record a minute, replay the trace: the same events come out -----
+printf '0 24.5 50\n20 36.0 48\n45 25.0 50\n' > "$OUT/record.dht"
+run record "$BUILD/record" --seconds 60 --finger 5-35@72 --dht "$OUT/record.dht" --press 40
+"$BUILD/replay" --seconds 60 < "$OUT/record.log" > "$OUT/replay.log" 2>&1
+echo $? > "$OUT/replay.status"
+exits replay 0 "replay runs to the end"
+expect replay 'HIGH TEMP: 36\.0' "replayed DHT reading raises the warning"
+expect replay 'Mode switched to' "replayed button press switches mode"
+events() {
+  grep -aoE '\[(BUTTON|WARNING|HEALTH|ALARM)\].*|hr [0-9]+ \(conf [0-9]+%\)|dht=[0-9]+\(err [0-9]+\)' "$1"
+}
+if diff <(events "$OUT/record.log") <(events "$OUT/replay.log") > "$OUT/replay.diff"; then
+  echo "ok    replay: same events, heart rate and DHT counts as the recording"
+else
+  echo "FAIL  replay: same events, heart rate and DHT counts as the recording (see $OUT/replay.diff)"
+  FAILED=1
+fi
+python3 ../tools/trace.py dump "$OUT/record.log" > "$OUT/dump.log" 2>&1
+count dump ' DHT +ok=1' 30 "trace.py reads every DHT record back"
+
+# ----- Offline for three minutes: the backlog drains in order -----
+# The temperature rises 0.5 C every 20 s, so each stored sample is warmer
+# than the last; their group timestamps must step by the 30 s interval
+awk 'BEGIN { for (i = 0; i < 16; i++) printf "%d %.1f 50\n", i * 20, 20 + i * 0.5 }' > "$OUT/store.dht"
+run store "$BUILD/clock" --seconds 300 --wifi-down 20-200 --dht "$OUT/store.dht" --blynk
+expect store '\[STORE\] Uploading 8 offline samples' "samples kept while offline"
+expect store '\[STORE\] Uploaded 8 samples' "the whole backlog uploaded after reconnecting"
+count store 'blynk > group +[0-9]+' 9 "one timestamped group per sample"
+if awk '/blynk > group +[0-9]+/ { time = $NF; next }
+        time != "" && /blynk > vw 2 / {
+          if (last != "" && (time - last != 30000 || $NF + 0 <= temp + 0)) bad = 1
+          last = time; temp = $NF; time = ""
+        }
+        END { exit bad || last == "" }' "$OUT/store.log"; then
+  echo "ok    store: samples upload oldest first, 30 s apart"
+else
+  echo "FAIL  store: samples upload oldest first, 30 s apart ($OUT/store.log)"
+  FAILED=1
+fi
+
+# ----- tools/blynk_server.py bench against the sketch, in real time -----
+PORT=$(python3 -c 'import socket; s = socket.socket(); s.bind(("127.0.0.1", 0)); print(s.getsockname()[1])')
+timeout 30 python3 ../tools/blynk_server.py bench --port "$PORT" --minutes 0.05 --rounds 3 \
+  --alarm-rounds 0 > "$OUT/bench.log" 2> "$OUT/bench.err" &
+SERVER=$!
+for _ in $(seq 50); do
+  grep -q 'listening' "$OUT/bench.err" 2> /dev/null && break
+  sleep 0.1
+done
+run server "$BUILD/clock" --seconds 12 --server "127.0.0.1:$PORT"
+wait $SERVER
+echo $? > "$OUT/bench.status"
+exits bench 0 "bench completes"
+expect bench '^frames/min +[0-9.]+' "idle traffic measured"
+expect bench '^next mode +n=3 ' "three next-mode round trips"
+expect server 'blynk [0-9]+ messages' "sketch ran against the server"
+
+exit $FAILED
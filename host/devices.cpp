@@ -0,0 +1,299 @@
+// GPIO-level peripheral models: DS1302 RTC, DHT11, button, buzzer and the
+// flash-backed EEPROM emulation.
+#include <Arduino.h>
+#include <DS1302.h>
+#include <EEPROM.h>
+#include "sim.h"
+
+#include <vector>
+
+EEPROMClass EEPROM;
+
+namespace sim {
+namespace {
+
+// Pins as wired in the sketch (PIN DEFINITIONS)
+const uint8_t DHT_GPIO = D3;
+const uint8_t BUTTON_GPIO = D6;
+const uint8_t BUZZER_GPIO = D7;
+
+// ----- Calendar, seconds since 2000-01-01 like the sketch -----
+bool leap(uint16_t y) {
+  return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+uint8_t monthDays(uint16_t y, uint8_t m) {
+  static const uint8_t DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  return m == 2 && leap(y) ? 29 : DAYS[m - 1];
+}
+
+int64_t toEpoch(uint16_t y, uint8_t mo, uint8_t d, uint8_t h, uint8_t mi, uint8_t s) {
+  int64_t days = 0;
+  for (uint16_t i = 2000; i < y; i++) days += leap(i) ? 366 : 365;
+  for (uint8_t i = 1; i < mo; i++) days += monthDays(y, i);
+  days += d - 1;
+  return days * 86400 + h * 3600 + mi * 60 + s;
+}
+
+Time fromEpoch(int64_t epoch) {
+  Time t;
+  int64_t days = epoch / 86400;
+  int64_t secs = epoch % 86400;
+  t.hour = secs / 3600;
+  t.min = secs / 60 % 60;
+  t.sec = secs % 60;
+  t.dow = (days + 5) % 7 + 1;   // 2000-01-01 was a Saturday, Monday = 1
+  t.year = 2000;
+  while (days >= (leap(t.year) ? 366 : 365)) days -= leap(t.year++) ? 366 : 365;
+  t.mon = 1;
+  while (days >= monthDays(t.year, t.mon)) days -= monthDays(t.year, t.mon++);
+  t.date = days + 1;
+  return t;
+}
+
+// ----- DS1302 -----
+// Keeps calendar time from the virtual clock. A burst read costs about
+// 150 us of bit-banging on the ESP8266.
+const uint32_t RTC_READ_US = 150;
+
+int64_t rtcBase = 0;         // RTC seconds at virtual time 0
+size_t rtcStepsApplied = 0;
+uint32_t rtcReads = 0;
+
+int64_t rtcNow() {
+  uint64_t now = nowUs();
+  while (rtcStepsApplied < scenario.rtcSteps.size() &&
+         scenario.rtcSteps[rtcStepsApplied].atUs <= now) {
+    const RtcStep &step = scenario.rtcSteps[rtcStepsApplied++];
+    rtcBase += step.seconds;
+    log("rtc set %+d s at %.3f s", step.seconds, step.atUs / 1e6);
+  }
+  return rtcBase + (int64_t)(now / 1000000);
+}
+
+// ----- DHT11 -----
+// Answers a start pulse of at least 18 ms with the usual waveform: 80 us
+// low, 80 us high, then 40 bits of 50 us low followed by 26 us (0) or
+// 70 us (1) high, and a final 50 us low. Readings come from the script;
+// the sensor reports whole percent and 0.1 C.
+struct DhtEntry {
+  uint64_t atUs;
+  enum { READING, TIMEOUT, CHECKSUM } kind;
+  int16_t temperature;   // 0.1 C
+  int16_t humidity;      // 0.1 %
+};
+
+std::vector<DhtEntry> dhtScript;
+bool dhtLow = false;
+uint64_t dhtLowSince = 0;
+uint32_t dhtReplies = 0;
+uint32_t dhtFaults = 0;
+
+void loadDhtScript(const std::string &path) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    log("dht: cannot open %s", path.c_str());
+    exit(2);
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    double at, temperature, humidity;
+    char word[16];
+    if (sscanf(line, "%lf %lf %lf", &at, &temperature, &humidity) == 3) {
+      dhtScript.push_back({(uint64_t)(at * 1e6), DhtEntry::READING,
+        (int16_t)lround(temperature * 10), (int16_t)lround(humidity * 10)});
+    } else if (sscanf(line, "%lf %15s", &at, word) == 2) {
+      bool timeout = strcmp(word, "timeout") == 0;
+      dhtScript.push_back({(uint64_t)(at * 1e6), timeout ? DhtEntry::TIMEOUT : DhtEntry::CHECKSUM, 0, 0});
+    }
+  }
+  fclose(f);
+}
+
+// The last entry in script order whose time has come; searched from the
+// end, so a script that grows as the run goes stays cheap
+DhtEntry dhtCurrent() {
+  for (size_t i = dhtScript.size(); i > 0; i--) {
+    if (dhtScript[i - 1].atUs <= nowUs()) return dhtScript[i - 1];
+  }
+  return {0, DhtEntry::READING, 250, 550};
+}
+
+void dhtReply() {
+  DhtEntry e = dhtCurrent();
+  if (e.kind == DhtEntry::TIMEOUT) {
+    dhtFaults++;
+    return;
+  }
+
+  int16_t t = e.temperature < 0 ? -e.temperature : e.temperature;
+  uint8_t data[5];
+  data[0] = e.humidity / 10;
+  data[1] = 0;
+  data[2] = t / 10;
+  data[3] = (t % 10) | (e.temperature < 0 ? 0x80 : 0);
+  data[4] = data[0] + data[1] + data[2] + data[3];
+  if (e.kind == DhtEntry::CHECKSUM) {
+    data[4] ^= 0x01;
+    dhtFaults++;
+  }
+
+  uint64_t t0 = nowUs() + 30;
+  schedulePin(t0, DHT_GPIO, LOW);
+  schedulePin(t0 + 80, DHT_GPIO, HIGH);
+  uint64_t at = t0 + 160;
+  for (uint8_t i = 0; i < 40; i++) {
+    bool one = data[i / 8] & (0x80 >> (i % 8));
+    schedulePin(at, DHT_GPIO, LOW);
+    schedulePin(at + 50, DHT_GPIO, HIGH);
+    at += 50 + (one ? 70 : 26);
+  }
+  schedulePin(at, DHT_GPIO, LOW);
+  schedulePin(at + 50, DHT_GPIO, HIGH);
+  dhtReplies++;
+}
+
+void dhtPinChanged() {
+  bool drivenLow = pinModeOf(DHT_GPIO) == OUTPUT && !pinOutput(DHT_GPIO);
+  if (drivenLow && !dhtLow) {
+    dhtLow = true;
+    dhtLowSince = nowUs();
+  } else if (!drivenLow && dhtLow) {
+    dhtLow = false;
+    if (pinModeOf(DHT_GPIO) != OUTPUT && nowUs() - dhtLowSince >= 18000) dhtReply();
+  }
+}
+
+// ----- Button -----
+// Each press bounces for about a millisecond on both edges
+void schedulePress(const Press &p) {
+  uint64_t up = p.atUs + p.holdMs * 1000ULL;
+  schedulePin(p.atUs, BUTTON_GPIO, LOW);
+  schedulePin(p.atUs + 300, BUTTON_GPIO, HIGH);
+  schedulePin(p.atUs + 700, BUTTON_GPIO, LOW);
+  schedulePin(up, BUTTON_GPIO, HIGH);
+  schedulePin(up + 400, BUTTON_GPIO, LOW);
+  schedulePin(up + 900, BUTTON_GPIO, HIGH);
+}
+
+// ----- Buzzer -----
+bool buzzerOn = false;
+uint64_t buzzerSince = 0;
+uint64_t buzzerOnUs = 0;
+uint32_t buzzerBeeps = 0;
+
+void buzzerPinChanged() {
+  bool on = pinModeOf(BUZZER_GPIO) == OUTPUT && pinOutput(BUZZER_GPIO);
+  if (on == buzzerOn) return;
+  buzzerOn = on;
+  if (on) {
+    buzzerBeeps++;
+    buzzerSince = nowUs();
+  } else {
+    buzzerOnUs += nowUs() - buzzerSince;
+  }
+}
+
+// ----- EEPROM -----
+// commit() rewrites the whole 4 KB flash sector, about 25 ms of erase
+// and program time during which the sketch is stalled
+const uint32_t EEPROM_COMMIT_US = 25000;
+
+std::vector<uint8_t> eeprom;
+bool eepromDirty = false;
+uint32_t eepromCommits = 0;
+
+}  // namespace
+
+void devicesBegin() {
+  int y, mo, d, h, mi, s;
+  if (sscanf(scenario.rtcStart.c_str(), "%d-%d-%d %d:%d:%d", &y, &mo, &d, &h, &mi, &s) != 6 || y < 2000) {
+    log("rtc: bad start time '%s'", scenario.rtcStart.c_str());
+    exit(2);
+  }
+  rtcBase = toEpoch(y, mo, d, h, mi, s);
+  if (!scenario.dhtScript.empty()) loadDhtScript(scenario.dhtScript);
+  for (const Press &p : scenario.presses) schedulePress(p);
+}
+
+void press(uint64_t atUs, uint32_t holdMs) {
+  scenario.presses.push_back({atUs, holdMs});
+  schedulePress(scenario.presses.back());
+}
+
+void dhtReading(uint64_t atUs, int16_t temperature, int16_t humidity) {
+  dhtScript.push_back({atUs, DhtEntry::READING, temperature, humidity});
+}
+
+void devicesPinChanged(uint8_t pin) {
+  if (pin == DHT_GPIO) dhtPinChanged();
+  if (pin == BUZZER_GPIO) buzzerPinChanged();
+}
+
+void devicesReport() {
+  if (buzzerOn) buzzerOnUs += nowUs() - buzzerSince;
+  log("rtc %u reads, dht %u replies (%u faults), %zu presses, buzzer %u beeps %llu ms, eeprom %u commits",
+    rtcReads, dhtReplies, dhtFaults, scenario.presses.size(), buzzerBeeps,
+    (unsigned long long)(buzzerOnUs / 1000), eepromCommits);
+}
+
+}  // namespace sim
+
+// ----- Library front ends -----
+Time DS1302::getTime() {
+  sim::rtcReads++;
+  sim::spend(sim::RTC_READ_US);
+  return sim::fromEpoch(sim::rtcNow());
+}
+
+void DS1302::setTime(uint8_t hour, uint8_t min, uint8_t sec) {
+  Time t = sim::fromEpoch(sim::rtcNow());
+  sim::rtcBase += sim::toEpoch(t.year, t.mon, t.date, hour, min, sec) - sim::rtcNow();
+}
+
+void DS1302::setDate(uint8_t date, uint8_t mon, uint16_t year) {
+  Time t = sim::fromEpoch(sim::rtcNow());
+  sim::rtcBase += sim::toEpoch(year, mon, date, t.hour, t.min, t.sec) - sim::rtcNow();
+}
+
+void DS1302::halt(bool value) {}
+
+void EEPROMClass::begin(size_t size) {
+  sim::eeprom.assign(size, 0xFF);
+  if (sim::scenario.eepromFile.empty()) return;
+  FILE* f = fopen(sim::scenario.eepromFile.c_str(), "rb");
+  if (!f) return;   // First boot: erased flash
+  size_t n = fread(sim::eeprom.data(), 1, size, f);
+  fclose(f);
+  sim::log("eeprom: loaded %zu bytes from %s", n, sim::scenario.eepromFile.c_str());
+}
+
+uint8_t EEPROMClass::read(int address) {
+  return address >= 0 && (size_t)address < sim::eeprom.size() ? sim::eeprom[address] : 0;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  if (address < 0 || (size_t)address >= sim::eeprom.size()) return;
+  if (sim::eeprom[address] != value) sim::eepromDirty = true;
+  sim::eeprom[address] = value;
+}
+
+bool EEPROMClass::commit() {
+  if (!sim::eepromDirty) return true;
+  sim::eepromDirty = false;
+  sim::eepromCommits++;
+  sim::spend(sim::EEPROM_COMMIT_US);
+  if (!sim::scenario.eepromFile.empty()) {
+    FILE* f = fopen(sim::scenario.eepromFile.c_str(), "wb");
+    if (f) {
+      fwrite(sim::eeprom.data(), 1, sim::eeprom.size(), f);
+      fclose(f);
+    }
+  }
+  return true;
+}
+
+size_t EEPROMClass::length() {
+  return sim::eeprom.size();
+}
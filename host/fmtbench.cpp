@@ -0,0 +1,136 @@
+// Display formatting benchmark: renders the fields that show temperature
+// and humidity with the sketch's fixed-point formatters and with the
+// float printf versions they replaced, and reports for each the cost of
+// one refresh (temperature, humidity and the Full Info summary line).
+//
+//   build/fmtbench
+//
+// Readings sweep -20.0 to 60.0 C and 0 to 100 % in DHT steps. Cycles are
+// host CPU cycles (the TSC on x86, else nanoseconds), so compare the two
+// rows rather than reading them as ESP8266 figures; on the device PERF
+// prints display cycles/field. The flash the float printf machinery
+// costs is not measured here: the host binary says nothing about it, and
+// it needs two ESP8266 builds to compare. The exit code is 1 when the
+// two formatters disagree on any reading.
+//
+// The sketch is compiled into this file so its globals are at hand.
+#include "sketch.cpp"
+
+#include <chrono>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+
+const int TIMING_PASSES = 20;
+const int16_t TEMP_FROM = -200;     // 0.1 C
+const int16_t TEMP_TO = 600;
+const int16_t HUMIDITY_STEP = 10;   // DHT11 reports whole percent
+
+uint64_t hostCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// One refresh of the three fields into text, so the result can be compared
+struct Refresh {
+  char temperature[7];
+  char humidity[5];
+  char summary[17];
+};
+
+// ----- The sketch's fields, fed from the fixed-point globals -----
+// Rendered as updateField() does: through the page table's pointer (not
+// inlined), into the field's width plus the terminator
+__attribute__((noinline)) void renderField(const PageField &f, char* buffer) {
+  f.render(buffer, f.width + 1);
+}
+
+void fixedRefresh(int16_t t, int16_t h, Refresh &r) {
+  temperature = t;
+  humidity = h;
+  renderField(TIME_FIELDS[2], r.temperature);
+  renderField(TIME_FIELDS[3], r.humidity);
+  renderField(FULL_FIELDS[1], r.summary);
+}
+
+// ----- The float versions the sketch used before -----
+void floatRefresh(int16_t t, int16_t h, Refresh &r) {
+  volatile float floatTemperature = t / 10.0f;
+  volatile float floatHumidity = h / 10.0f;
+  snprintf(r.temperature, sizeof(r.temperature), "%.1fC", floatTemperature);
+  snprintf(r.humidity, sizeof(r.humidity), "%d%%", (int)floatHumidity);
+  snprintf(r.summary, sizeof(r.summary), "%.1fC %d%% %dBPM", floatTemperature,
+    (int)floatHumidity, heartRate);
+}
+
+struct Result {
+  double cycles;       // Per refresh, best of TIMING_PASSES
+  int refreshes;
+};
+
+Result measure(void (*refresh)(int16_t, int16_t, Refresh &)) {
+  Result r = {1e9, 0};
+  Refresh out;
+  for (int pass = 0; pass < TIMING_PASSES; pass++) {
+    int count = 0;
+    uint64_t start = hostCycles();
+    for (int16_t t = TEMP_FROM; t <= TEMP_TO; t++) {
+      for (int16_t h = 0; h <= 1000; h += HUMIDITY_STEP) {
+        refresh(t, h, out);
+        count++;
+      }
+    }
+    double cycles = (double)(hostCycles() - start) / count;
+    if (cycles < r.cycles) r.cycles = cycles;
+    r.refreshes = count;
+  }
+  return r;
+}
+
+// The texts must match for every reading, or the timing means nothing
+int compare() {
+  int mismatches = 0;
+  for (int16_t t = TEMP_FROM; t <= TEMP_TO; t++) {
+    for (int16_t h = 0; h <= 1000; h += HUMIDITY_STEP) {
+      Refresh a, b;
+      fixedRefresh(t, h, a);
+      floatRefresh(t, h, b);
+      if (strcmp(a.temperature, b.temperature) == 0 && strcmp(a.humidity, b.humidity) == 0 &&
+          strcmp(a.summary, b.summary) == 0) continue;
+      if (mismatches++ < 5) {
+        printf("[BENCH] mismatch at %d/%d: \"%s\" \"%s\" \"%s\" vs \"%s\" \"%s\" \"%s\"\n", t, h,
+          a.temperature, a.humidity, a.summary, b.temperature, b.humidity, b.summary);
+      }
+    }
+  }
+  return mismatches;
+}
+
+void report(const char* name, const Result &r) {
+  printf("[BENCH] %-6s %6.1f cycles/refresh over %d readings\n", name, r.cycles, r.refreshes);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    fprintf(stderr, "usage: fmtbench\n");
+    return 2;
+  }
+
+  heartRate = 72;
+  int mismatches = compare();
+  Result fixed = measure(fixedRefresh);
+  Result floating = measure(floatRefresh);
+  report("fixed", fixed);
+  report("float", floating);
+  printf("[BENCH] fixed/float %.2f, %d mismatches\n", fixed.cycles / floating.cycles, mismatches);
+  return mismatches ? 1 : 0;
+}
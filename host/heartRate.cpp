@@ -0,0 +1,75 @@
+// SparkFun's heartRate.cpp (PBA algorithm, Maxim app note), kept to the
+// library's arithmetic: a 16-bit DC estimator, a 23-tap low-pass FIR and
+// a beat on every positive zero crossing of a plausible AC swing. Note
+// that the sample is truncated to 16 bits on entry, as in the library.
+#include <heartRate.h>
+
+namespace {
+
+int16_t IR_AC_Max = 20;
+int16_t IR_AC_Min = -20;
+int16_t IR_AC_Signal_Current = 0;
+int16_t IR_AC_Signal_Previous;
+int16_t IR_AC_Signal_min = 0;
+int16_t IR_AC_Signal_max = 0;
+int16_t IR_Average_Estimated;
+int16_t positiveEdge = 0;
+int16_t negativeEdge = 0;
+int32_t ir_avg_reg = 0;
+
+int16_t cbuf[32];
+uint8_t offset = 0;
+
+const uint16_t FIRCoeffs[12] = {172, 321, 579, 927, 1360, 1858, 2390, 2916, 3391, 3768, 4012, 4096};
+
+int32_t mul16(int16_t x, int16_t y) {
+  return (int32_t)x * (int32_t)y;
+}
+
+int16_t averageDCEstimator(int32_t* p, uint16_t x) {
+  *p += (((int32_t)x << 15) - *p) >> 4;
+  return *p >> 15;
+}
+
+int16_t lowPassFIRFilter(int16_t din) {
+  cbuf[offset] = din;
+  int32_t z = mul16(FIRCoeffs[11], cbuf[(offset - 11) & 0x1F]);
+  for (uint8_t i = 0; i < 11; i++) {
+    z += mul16(FIRCoeffs[i], cbuf[(offset - i) & 0x1F] + cbuf[(offset - 22 + i) & 0x1F]);
+  }
+  offset++;
+  offset %= 32;
+  return z >> 15;
+}
+
+}  // namespace
+
+bool checkForBeat(int32_t sample) {
+  bool beatDetected = false;
+
+  IR_AC_Signal_Previous = IR_AC_Signal_Current;
+  IR_Average_Estimated = averageDCEstimator(&ir_avg_reg, sample);
+  IR_AC_Signal_Current = lowPassFIRFilter(sample - IR_Average_Estimated);
+
+  // Positive zero crossing: a beat if the last swing looked like one
+  if (IR_AC_Signal_Previous < 0 && IR_AC_Signal_Current >= 0) {
+    IR_AC_Max = IR_AC_Signal_max;
+    IR_AC_Min = IR_AC_Signal_min;
+    positiveEdge = 1;
+    negativeEdge = 0;
+    IR_AC_Signal_max = 0;
+    if (IR_AC_Max - IR_AC_Min > 20 && IR_AC_Max - IR_AC_Min < 1000) beatDetected = true;
+  }
+
+  // Negative zero crossing
+  if (IR_AC_Signal_Previous > 0 && IR_AC_Signal_Current <= 0) {
+    positiveEdge = 0;
+    negativeEdge = 1;
+    IR_AC_Signal_min = 0;
+  }
+
+  if (positiveEdge && IR_AC_Signal_Current > IR_AC_Signal_Previous) IR_AC_Signal_max = IR_AC_Signal_Current;
+  if (negativeEdge && IR_AC_Signal_Current < IR_AC_Signal_Previous) IR_AC_Signal_min = IR_AC_Signal_Current;
+
+  return beatDetected;
+}
@@ -0,0 +1,709 @@
+// I2C bus and the two devices on it: the PCF8574 backpack driving an
+// HD44780 16x2 LCD (0x27) and the MAX30102 pulse sensor (0x57). Also the
+// LiquidCrystal_I2C and SparkFun MAX30105 front ends the sketch calls.
+#include <Wire.h>
+#include <LiquidCrystal_I2C.h>
+#include <MAX30105.h>
+#include "sim.h"
+
+#include <vector>
+
+TwoWire Wire;
+
+namespace sim {
+namespace {
+
+// ----- Bus -----
+// Every byte is 9 clocks (8 data + ACK); a transaction adds the address
+// byte and about two clocks for START and STOP. Devices see each byte at
+// the time it completes on the wire.
+uint32_t busClock = 100000;
+uint32_t busTransactions = 0;
+uint32_t busBytes = 0;
+uint32_t busNacks = 0;
+
+void busClocks(uint32_t clocks) {
+  spend(((uint64_t)clocks * 1000000 + busClock - 1) / busClock);
+}
+
+class Device {
+public:
+  virtual ~Device() {}
+  virtual void start() {}
+  virtual void writeByte(uint8_t b) = 0;
+  virtual uint8_t readByte() = 0;
+};
+
+// ----- HD44780 behind a PCF8574 -----
+// The expander drives the controller's pins directly: P0=RS, P1=RW,
+// P2=EN, P3=backlight, P4-P7=D4-D7. The controller latches on the
+// falling edge of EN. It powers up in 8-bit mode, where each EN pulse is
+// a whole instruction (D0-D3 read as 0), until a function set with DL=0.
+// Instructions arriving while the previous one still executes, or within
+// 40 ms of power-on, are lost on real hardware; the model counts them and
+// drops them too, so a missing wait shows up as missing text.
+const uint8_t EXP_RS = 0x01;
+const uint8_t EXP_EN = 0x04;
+const uint8_t EXP_BACKLIGHT = 0x08;
+const uint32_t HD_POWER_ON_US = 40000;
+const uint32_t HD_EXEC_US = 37;
+const uint32_t HD_CLEAR_US = 1520;
+const uint32_t HD_FIRST_FUNCTION_SET_US = 4100;
+
+bool lcdDirty = false;
+
+void lcdChanged() {
+  lcdDirty = true;
+}
+
+class Lcd : public Device {
+public:
+  uint8_t ddram[0x80];
+  uint8_t cgram[64];
+  bool backlight = false;
+  bool displayOn = false;
+  uint32_t instructions = 0;
+  uint32_t lost = 0;
+  uint64_t firstTextUs = 0;   // First visible character, 0 = none yet
+
+  Lcd() {
+    memset(ddram, ' ', sizeof(ddram));
+    memset(cgram, 0, sizeof(cgram));
+  }
+
+  void writeByte(uint8_t b) override {
+    backlight = b & EXP_BACKLIGHT;
+    if ((pins & EXP_EN) && !(b & EXP_EN)) latch(pins >> 4, pins & EXP_RS);
+    pins = b;
+  }
+
+  uint8_t readByte() override {
+    return pins;
+  }
+
+private:
+  uint8_t pins = 0;
+  bool fourBit = false;
+  bool haveHigh = false;
+  uint8_t high = 0;
+  bool cgramMode = false;
+  uint8_t address = 0;
+  bool initialised = false;
+  uint64_t busyUntil = 0;
+
+  void latch(uint8_t nibble, bool rs) {
+    if (!fourBit) {
+      execute(nibble << 4, rs);
+      return;
+    }
+    if (!haveHigh) {
+      high = nibble;
+      haveHigh = true;
+      return;
+    }
+    haveHigh = false;
+    execute(high << 4 | nibble, rs);
+  }
+
+  void execute(uint8_t value, bool rs) {
+    uint64_t now = nowUs();
+    if (now + scenario.uptimeUs < HD_POWER_ON_US || now < busyUntil) {
+      lost++;
+      return;
+    }
+    instructions++;
+    uint32_t execUs = HD_EXEC_US;
+
+    if (rs) {
+      if (cgramMode) {
+        cgram[address & 0x3F] = value;
+        address = (address + 1) & 0x3F;
+      } else {
+        ddram[address] = value;
+        if (value != ' ' && firstTextUs == 0) firstTextUs = now;
+        address = nextDdram(address);
+        lcdChanged();
+      }
+    } else if (value & 0x80) {
+      cgramMode = false;
+      address = value & 0x7F;
+    } else if (value & 0x40) {
+      cgramMode = true;
+      address = value & 0x3F;
+    } else if (value & 0x20) {
+      bool dl = value & 0x10;
+      if (!initialised) {
+        execUs = HD_FIRST_FUNCTION_SET_US;
+        initialised = true;
+      }
+      if (!dl && !fourBit) {
+        fourBit = true;
+        haveHigh = false;
+      } else if (dl) {
+        fourBit = false;
+      }
+    } else if (value & 0x10) {
+      // Cursor or display shift: not used by the sketch
+    } else if (value & 0x08) {
+      displayOn = value & 0x04;
+      lcdChanged();
+    } else if (value & 0x04) {
+      // Entry mode: the sketch keeps the default left-to-right
+    } else if (value & 0x02) {
+      cgramMode = false;
+      address = 0;
+      execUs = HD_CLEAR_US;
+    } else if (value & 0x01) {
+      memset(ddram, ' ', sizeof(ddram));
+      cgramMode = false;
+      address = 0;
+      execUs = HD_CLEAR_US;
+      lcdChanged();
+    }
+    busyUntil = now + execUs;
+  }
+
+  // Line 1 is 0x00-0x27 and line 2 0x40-0x67; each wraps into the other
+  static uint8_t nextDdram(uint8_t a) {
+    if (a == 0x27) return 0x40;
+    if (a == 0x67) return 0x00;
+    return a + 1;
+  }
+};
+
+Lcd lcd;
+std::string lcdShown[2];
+
+// ----- MAX30102 -----
+// 32-sample FIFO with write/read pointers and an overflow counter, filled
+// at the configured rate (SPO2_CONFIG sample rate / FIFO_CONFIG
+// averaging) from the moment a measurement mode is set. Samples are
+// produced lazily up to the current time on every bus access. The
+// register pointer auto-increments except on FIFO_DATA, which pops a
+// sample every 6 bytes (red then IR, 18 bits each).
+const uint8_t REG_INT_STATUS1 = 0x00;
+const uint8_t REG_INT_ENABLE1 = 0x02;
+const uint8_t REG_FIFO_WR_PTR = 0x04;
+const uint8_t REG_OVF_COUNTER = 0x05;
+const uint8_t REG_FIFO_RD_PTR = 0x06;
+const uint8_t REG_FIFO_DATA = 0x07;
+const uint8_t REG_FIFO_CONFIG = 0x08;
+const uint8_t REG_MODE_CONFIG = 0x09;
+const uint8_t REG_SPO2_CONFIG = 0x0A;
+const uint8_t REG_PART_ID = 0xFF;
+const uint8_t PART_ID = 0x15;
+const uint8_t FIFO_DEPTH = 32;
+
+struct Sample {
+  uint32_t red;
+  uint32_t ir;
+};
+
+std::vector<Sample> ppgTrace;
+size_t ppgTracePos = 0;
+uint32_t noiseState = 12345;
+
+int32_t noise(int32_t amplitude) {
+  noiseState = noiseState * 1103515245 + 12345;
+  return (int32_t)((noiseState >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+// Reflected IR at time t. With a finger on the sensor the DC level sits
+// around 110000 and each pulse dips it (more blood absorbs more light):
+// a fast systolic drop, slow recovery and a small dicrotic notch, plus
+// breathing drift and noise. Without a finger only ambient light remains.
+Sample ppgSample(uint64_t us) {
+  if (ppgTracePos < ppgTrace.size()) return ppgTrace[ppgTracePos++];
+
+  double t = us / 1e6;
+  for (const Finger &f : scenario.fingers) {
+    if (us < f.when.startUs || us >= f.when.endUs) continue;
+    double phase = fmod(t * f.bpm / 60.0, 1.0);
+    double pulse = phase < 0.12 ? sin(M_PI / 2 * phase / 0.12)
+                                : exp(-(phase - 0.12) * 5) + 0.15 * exp(-pow((phase - 0.45) / 0.05, 2));
+    double drift = 300 * sin(2 * M_PI * 0.25 * t);
+    uint32_t ir = (uint32_t)(110000 + drift - 1500 * pulse + noise(40));
+    uint32_t red = (uint32_t)(ir * 0.8 + noise(40));
+    return {red & 0x3FFFF, ir & 0x3FFFF};
+  }
+  return {(uint32_t)(2500 + noise(200)), (uint32_t)(3000 + noise(200))};
+}
+
+// Samples from the PPG records of a trace (tools/trace.py layout)
+void loadPpgTrace(const std::string &path) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    log("ppg: cannot open %s", path.c_str());
+    exit(2);
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+  fclose(f);
+
+  size_t i = 0;
+  while (i + 8 <= data.size()) {
+    uint8_t len = data[i + 2];
+    if (data[i] != 0xA5 || i + 8 + len > data.size()) {
+      i++;
+      continue;
+    }
+    uint8_t crc = 0;
+    for (size_t k = i + 1; k < i + 7 + len; k++) {
+      crc ^= data[k];
+      for (uint8_t b = 0; b < 8; b++) crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    if (crc != data[i + 7 + len]) {
+      i++;
+      continue;
+    }
+    const uint8_t* p = &data[i + 7];
+    if (data[i + 1] == 1) {
+      for (uint8_t s = 0; s < p[0] && 1 + s * 6 + 6 <= len; s++) {
+        const uint8_t* q = p + 1 + s * 6;
+        ppgTrace.push_back({(uint32_t)(q[0] | q[1] << 8 | q[2] << 16),
+                            (uint32_t)(q[3] | q[4] << 8 | q[5] << 16)});
+      }
+    }
+    i += 8 + len;
+  }
+  log("ppg: %zu samples from %s", ppgTrace.size(), path.c_str());
+}
+
+class Max30102 : public Device {
+public:
+  uint32_t produced = 0;
+  uint32_t overflowed = 0;
+
+  Max30102() {
+    reset();
+  }
+
+  void start() override {
+    produce();
+    byteIndex = 0;
+    first = true;
+  }
+
+  void writeByte(uint8_t b) override {
+    if (first) {
+      pointer = b;
+      first = false;
+      return;
+    }
+    writeRegister(pointer, b);
+    if (pointer != REG_FIFO_DATA) pointer++;
+  }
+
+  uint8_t readByte() override {
+    if (pointer == REG_FIFO_DATA) return readFifo();
+    uint8_t value = regs[pointer];
+    if (pointer == REG_INT_STATUS1) regs[pointer] = 0;   // Cleared on read
+    pointer++;
+    return value;
+  }
+
+private:
+  uint8_t regs[256];
+  Sample fifo[FIFO_DEPTH];
+  uint8_t count = 0;
+  uint8_t pointer = 0;
+  bool first = true;
+  uint8_t byteIndex = 0;
+  uint64_t nextSampleUs = 0;
+
+  void reset() {
+    memset(regs, 0, sizeof(regs));
+    regs[REG_PART_ID] = PART_ID;
+    count = 0;
+  }
+
+  bool active() {
+    uint8_t mode = regs[REG_MODE_CONFIG] & 0x07;
+    return mode == 0x02 || mode == 0x03 || mode == 0x07;
+  }
+
+  uint32_t samplePeriodUs() {
+    static const uint16_t RATES[] = {50, 100, 200, 400, 800, 1000, 1600, 3200};
+    static const uint8_t AVERAGES[] = {1, 2, 4, 8, 16, 32, 32, 32};
+    uint32_t rate = RATES[(regs[REG_SPO2_CONFIG] >> 2) & 0x07];
+    uint32_t average = AVERAGES[regs[REG_FIFO_CONFIG] >> 5];
+    return 1000000 * average / rate;
+  }
+
+  void writeRegister(uint8_t reg, uint8_t value) {
+    if (reg == REG_MODE_CONFIG && (value & 0x40)) {
+      reset();
+      return;
+    }
+    bool wasActive = active();
+    regs[reg] = value;
+    if (reg == REG_FIFO_WR_PTR || reg == REG_FIFO_RD_PTR) {
+      regs[reg] &= FIFO_DEPTH - 1;
+      count = (regs[REG_FIFO_WR_PTR] - regs[REG_FIFO_RD_PTR]) & (FIFO_DEPTH - 1);
+    }
+    if (!wasActive && active()) nextSampleUs = nowUs() + samplePeriodUs();
+  }
+
+  void produce() {
+    if (!active()) return;
+    uint64_t now = nowUs();
+    uint32_t period = samplePeriodUs();
+    while (nextSampleUs <= now) {
+      push(ppgSample(nextSampleUs));
+      nextSampleUs += period;
+    }
+  }
+
+  void push(const Sample &s) {
+    produced++;
+    if (count == FIFO_DEPTH) {
+      overflowed++;
+      if (regs[REG_OVF_COUNTER] < 0x1F) regs[REG_OVF_COUNTER]++;
+      if (!(regs[REG_FIFO_CONFIG] & 0x10)) return;             // No rollover: sample lost
+      regs[REG_FIFO_RD_PTR] = (regs[REG_FIFO_RD_PTR] + 1) & (FIFO_DEPTH - 1);
+      count--;
+    }
+    fifo[regs[REG_FIFO_WR_PTR]] = s;
+    regs[REG_FIFO_WR_PTR] = (regs[REG_FIFO_WR_PTR] + 1) & (FIFO_DEPTH - 1);
+    count++;
+    uint8_t almostFull = FIFO_DEPTH - (regs[REG_FIFO_CONFIG] & 0x0F);
+    if (count >= almostFull && (regs[REG_INT_ENABLE1] & 0x80)) regs[REG_INT_STATUS1] |= 0x80;
+  }
+
+  uint8_t readFifo() {
+    const Sample &s = fifo[regs[REG_FIFO_RD_PTR]];
+    uint32_t value = byteIndex < 3 ? s.red : s.ir;
+    uint8_t shift = 16 - 8 * (byteIndex % 3);
+    uint8_t b = value >> shift;
+    if (++byteIndex == 6) {
+      byteIndex = 0;
+      if (count > 0) {
+        regs[REG_FIFO_RD_PTR] = (regs[REG_FIFO_RD_PTR] + 1) & (FIFO_DEPTH - 1);
+        count--;
+        regs[REG_OVF_COUNTER] = 0;
+      }
+    }
+    return b;
+  }
+};
+
+Max30102 ppg;
+
+Device* device(uint8_t address) {
+  if (address == 0x27) return &lcd;
+  if (address == MAX30105_ADDRESS) return &ppg;
+  return nullptr;
+}
+
+}  // namespace
+
+std::string lcdText(uint8_t row) {
+  std::string text;
+  for (uint8_t c = 0; c < 16; c++) {
+    uint8_t ch = lcd.ddram[row * 0x40 + c];
+    if (!lcd.displayOn) ch = ' ';
+    if (ch < 0x10) {
+      text += '#';
+    } else if (ch == 0xDF) {
+      text += 'o';   // Degree sign in the HD44780 ROM
+    } else if (ch < 0x20 || ch > 0x7E) {
+      text += '?';
+    } else {
+      text += (char)ch;
+    }
+  }
+  return text;
+}
+
+void lcdPass() {
+  if (!lcdDirty || !scenario.showLcd) return;
+  lcdDirty = false;
+  std::string text[2] = {lcdText(0), lcdText(1)};
+  if (text[0] == lcdShown[0] && text[1] == lcdShown[1]) return;
+  log("lcd |%s|%s|", text[0].c_str(), text[1].c_str());
+  lcdShown[0] = text[0];
+  lcdShown[1] = text[1];
+}
+
+void i2cReport() {
+  log("i2c %u kHz, %u transactions, %u bytes, %u nacks", busClock / 1000, busTransactions,
+    busBytes, busNacks);
+  log("lcd %u instructions, %u lost (busy or before power-on), backlight %s, first text at %.1f ms",
+    lcd.instructions, lcd.lost, lcd.backlight ? "on" : "off", lcd.firstTextUs / 1000.0);
+  log("max30102 %u samples, %u overflowed", ppg.produced, ppg.overflowed);
+}
+
+void i2cBegin() {
+  if (!scenario.ppgTrace.empty()) loadPpgTrace(scenario.ppgTrace);
+}
+
+}  // namespace sim
+
+// ----- TwoWire -----
+void TwoWire::setClock(uint32_t frequency) {
+  sim::busClock = frequency;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  txAddress = address;
+  txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  if (txLength == BUFFER_LENGTH) return 0;
+  txBuffer[txLength++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t quantity) {
+  size_t n = 0;
+  while (n < quantity && write(data[n])) n++;
+  return n;
+}
+
+// 0 on success, 2 when nobody acknowledges the address
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  sim::busTransactions++;
+  sim::busClocks(1 + 9);
+  sim::Device* dev = sim::device(txAddress);
+  if (!dev) {
+    sim::busNacks++;
+    return 2;
+  }
+  dev->start();
+  for (uint8_t i = 0; i < txLength; i++) {
+    sim::busClocks(9);
+    sim::busBytes++;
+    dev->writeByte(txBuffer[i]);
+  }
+  sim::busClocks(1);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool sendStop) {
+  if (quantity > BUFFER_LENGTH) quantity = BUFFER_LENGTH;
+  rxIndex = 0;
+  rxLength = 0;
+  sim::busTransactions++;
+  sim::busClocks(1 + 9);
+  sim::Device* dev = sim::device(address);
+  if (!dev) {
+    sim::busNacks++;
+    return 0;
+  }
+  dev->start();
+  for (uint8_t i = 0; i < quantity; i++) {
+    sim::busClocks(9);
+    sim::busBytes++;
+    rxBuffer[rxLength++] = dev->readByte();
+  }
+  sim::busClocks(1);
+  return rxLength;
+}
+
+int TwoWire::available() {
+  return rxLength - rxIndex;
+}
+
+int TwoWire::read() {
+  return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1;
+}
+
+// ----- LiquidCrystal_I2C -----
+// Same sequence and waits as the library: one expander write per nibble
+// plus an EN pulse, and the datasheet's 4-bit init after a generous
+// power-up delay.
+#define LCD_CLEARDISPLAY   0x01
+#define LCD_RETURNHOME     0x02
+#define LCD_ENTRYMODESET   0x04
+#define LCD_DISPLAYCONTROL 0x08
+#define LCD_FUNCTIONSET    0x20
+#define LCD_SETCGRAMADDR   0x40
+#define LCD_SETDDRAMADDR   0x80
+#define LCD_ENTRYLEFT      0x02
+#define LCD_DISPLAYON      0x04
+#define LCD_2LINE          0x08
+#define LCD_4BITMODE       0x00
+#define En 0x04
+#define Rs 0x01
+
+void LiquidCrystal_I2C::init() {
+  delay(50);
+  expanderWrite(backlightVal);
+  delay(1000);
+
+  write4bits(0x03 << 4);
+  delayMicroseconds(4500);
+  write4bits(0x03 << 4);
+  delayMicroseconds(4500);
+  write4bits(0x03 << 4);
+  delayMicroseconds(150);
+  write4bits(0x02 << 4);
+
+  command(LCD_FUNCTIONSET | LCD_4BITMODE | LCD_2LINE);
+  command(LCD_DISPLAYCONTROL | LCD_DISPLAYON);
+  clear();
+  command(LCD_ENTRYMODESET | LCD_ENTRYLEFT);
+  home();
+}
+
+void LiquidCrystal_I2C::clear() {
+  command(LCD_CLEARDISPLAY);
+  delayMicroseconds(2000);
+}
+
+void LiquidCrystal_I2C::home() {
+  command(LCD_RETURNHOME);
+  delayMicroseconds(2000);
+}
+
+void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row) {
+  static const uint8_t ROW_OFFSETS[] = {0x00, 0x40, 0x14, 0x54};
+  if (row >= rows) row = rows - 1;
+  command(LCD_SETDDRAMADDR | (col + ROW_OFFSETS[row]));
+}
+
+void LiquidCrystal_I2C::backlight() {
+  backlightVal = 0x08;
+  expanderWrite(0);
+}
+
+void LiquidCrystal_I2C::noBacklight() {
+  backlightVal = 0x00;
+  expanderWrite(0);
+}
+
+void LiquidCrystal_I2C::createChar(uint8_t location, const uint8_t charmap[]) {
+  location &= 0x7;
+  command(LCD_SETCGRAMADDR | (location << 3));
+  for (uint8_t i = 0; i < 8; i++) write(charmap[i]);
+}
+
+void LiquidCrystal_I2C::command(uint8_t value) {
+  send(value, 0);
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t value) {
+  send(value, Rs);
+  return 1;
+}
+
+void LiquidCrystal_I2C::send(uint8_t value, uint8_t mode) {
+  write4bits((value & 0xF0) | mode);
+  write4bits(((value << 4) & 0xF0) | mode);
+}
+
+void LiquidCrystal_I2C::write4bits(uint8_t value) {
+  expanderWrite(value);
+  pulseEnable(value);
+}
+
+void LiquidCrystal_I2C::expanderWrite(uint8_t data) {
+  Wire.beginTransmission(address);
+  Wire.write(data | backlightVal);
+  Wire.endTransmission();
+}
+
+void LiquidCrystal_I2C::pulseEnable(uint8_t data) {
+  expanderWrite(data | En);
+  delayMicroseconds(1);
+  expanderWrite(data & ~En);
+  delayMicroseconds(50);
+}
+
+// ----- MAX30105 (SparkFun) -----
+bool MAX30105::begin(TwoWire &wirePort, uint32_t i2cSpeed, uint8_t address) {
+  i2cPort = &wirePort;
+  i2caddr = address;
+  i2cPort->setClock(i2cSpeed);
+  return readPartID() == sim::PART_ID;
+}
+
+void MAX30105::setup(uint8_t powerLevel, uint8_t sampleAverage, uint8_t ledMode,
+                     int sampleRate, int pulseWidth, int adcRange) {
+  softReset();
+
+  uint8_t average = sampleAverage >= 32 ? 5 : sampleAverage >= 16 ? 4 : sampleAverage >= 8 ? 3
+                  : sampleAverage >= 4 ? 2 : sampleAverage >= 2 ? 1 : 0;
+  bitMask(sim::REG_FIFO_CONFIG, 0x1F, average << 5);
+  bitMask(sim::REG_FIFO_CONFIG, 0xEF, 0x10);   // Rollover
+
+  bitMask(sim::REG_MODE_CONFIG, 0xF8, ledMode == 3 ? 0x07 : ledMode == 2 ? 0x03 : 0x02);
+
+  uint8_t range = adcRange < 4096 ? 0 : adcRange < 8192 ? 1 : adcRange < 16384 ? 2 : 3;
+  bitMask(sim::REG_SPO2_CONFIG, 0x9F, range << 5);
+  uint8_t rate = sampleRate < 100 ? 0 : sampleRate < 200 ? 1 : sampleRate < 400 ? 2
+               : sampleRate < 800 ? 3 : sampleRate < 1000 ? 4 : sampleRate < 1600 ? 5
+               : sampleRate < 3200 ? 6 : 7;
+  bitMask(sim::REG_SPO2_CONFIG, 0xE3, rate << 2);
+  uint8_t width = pulseWidth < 118 ? 0 : pulseWidth < 215 ? 1 : pulseWidth < 411 ? 2 : 3;
+  bitMask(sim::REG_SPO2_CONFIG, 0xFC, width);
+
+  setPulseAmplitudeRed(powerLevel);
+  setPulseAmplitudeIR(powerLevel);
+  clearFIFO();
+}
+
+void MAX30105::softReset() {
+  bitMask(sim::REG_MODE_CONFIG, 0xBF, 0x40);
+}
+
+void MAX30105::setPulseAmplitudeRed(uint8_t value) {
+  writeRegister8(i2caddr, 0x0C, value);
+}
+
+void MAX30105::setPulseAmplitudeIR(uint8_t value) {
+  writeRegister8(i2caddr, 0x0D, value);
+}
+
+void MAX30105::setFIFOAlmostFull(uint8_t samples) {
+  bitMask(sim::REG_FIFO_CONFIG, 0xF0, samples);
+}
+
+void MAX30105::enableAFULL() {
+  bitMask(sim::REG_INT_ENABLE1, 0x7F, 0x80);
+}
+
+void MAX30105::clearFIFO() {
+  writeRegister8(i2caddr, sim::REG_FIFO_WR_PTR, 0);
+  writeRegister8(i2caddr, sim::REG_OVF_COUNTER, 0);
+  writeRegister8(i2caddr, sim::REG_FIFO_RD_PTR, 0);
+}
+
+uint8_t MAX30105::getReadPointer() {
+  return readRegister8(i2caddr, sim::REG_FIFO_RD_PTR);
+}
+
+uint8_t MAX30105::getWritePointer() {
+  return readRegister8(i2caddr, sim::REG_FIFO_WR_PTR);
+}
+
+uint8_t MAX30105::getINT1() {
+  return readRegister8(i2caddr, sim::REG_INT_STATUS1);
+}
+
+uint8_t MAX30105::readPartID() {
+  return readRegister8(i2caddr, sim::REG_PART_ID);
+}
+
+uint8_t MAX30105::readRegister8(uint8_t address, uint8_t reg) {
+  i2cPort->beginTransmission(address);
+  i2cPort->write(reg);
+  i2cPort->endTransmission(false);
+  i2cPort->requestFrom(address, (uint8_t)1);
+  return i2cPort->available() ? i2cPort->read() : 0;
+}
+
+void MAX30105::writeRegister8(uint8_t address, uint8_t reg, uint8_t value) {
+  i2cPort->beginTransmission(address);
+  i2cPort->write(reg);
+  i2cPort->write(value);
+  i2cPort->endTransmission();
+}
+
+void MAX30105::bitMask(uint8_t reg, uint8_t mask, uint8_t thing) {
+  uint8_t original = readRegister8(i2caddr, reg);
+  writeRegister8(i2caddr, reg, (original & mask) | thing);
+}
@@ -0,0 +1,158 @@
+// Host build: the Blynk client API the sketch uses, against a simulated
+// server (host/network.cpp). Messages are sized like the library's, so
+// anything the real client would truncate or drop is reported.
+#pragma once
+
+#include <ESP8266WiFi.h>
+
+#ifndef BLYNK_MAX_SENDBYTES
+#define BLYNK_MAX_SENDBYTES 128
+#endif
+
+#define V0 0
+#define V1 1
+#define V2 2
+#define V3 3
+#define V4 4
+#define V5 5
+#define V6 6
+#define V7 7
+#define V8 8
+#define V9 9
+#define V10 10
+#define V11 11
+#define V12 12
+#define V13 13
+#define V14 14
+#define V15 15
+#define V16 16
+#define V17 17
+#define V18 18
+#define V19 19
+#define V20 20
+#define V21 21
+#define V22 22
+#define V23 23
+#define V24 24
+#define V25 25
+#define V26 26
+#define V27 27
+#define V28 28
+#define V29 29
+#define V30 30
+#define V31 31
+#define V32 32
+#define V33 33
+#define V34 34
+#define V35 35
+#define V36 36
+#define V37 37
+#define V38 38
+#define V39 39
+#define V40 40
+#define V41 41
+#define V42 42
+#define V43 43
+#define V44 44
+#define V45 45
+#define V46 46
+#define V47 47
+#define V48 48
+#define V49 49
+#define V50 50
+#define V51 51
+#define V52 52
+#define V53 53
+#define V54 54
+#define V55 55
+#define V56 56
+#define V57 57
+#define V58 58
+#define V59 59
+#define V60 60
+#define V61 61
+#define V62 62
+#define V63 63
+
+// Values travel as strings, as in the protocol
+class BlynkParam {
+public:
+  BlynkParam(void* addr, size_t length, size_t size)
+    : buffer((char*)addr), length(length), size(size) {}
+
+  void add(long value) {
+    char text[16];
+    snprintf(text, sizeof(text), "%ld", value);
+    add(text);
+  }
+  void add(int value) { add((long)value); }
+  void add(const char* value) {
+    size_t n = strlen(value) + 1;
+    if (length + n > size) return;
+    memcpy(buffer + length, value, n);
+    length += n;
+  }
+
+  const char* asStr() const { return length ? buffer : ""; }
+  int asInt() const { return atoi(asStr()); }
+  long asLong() const { return atol(asStr()); }
+  double asDouble() const { return atof(asStr()); }
+  float asFloat() const { return atof(asStr()); }
+  size_t getLength() const { return length; }
+
+private:
+  char* buffer;
+  size_t length;
+  size_t size;
+};
+
+struct BlynkReq {
+  uint8_t pin;
+};
+
+typedef void (*WidgetWriteHandler)(BlynkReq &request, const BlynkParam &param);
+
+// Handler defined with BLYNK_WRITE() for a pin, or nullptr
+WidgetWriteHandler GetWriteHandler(uint8_t pin);
+
+#define BLYNK_WRITE_2(pin) void BlynkWidgetWrite ## pin (BlynkReq &request, const BlynkParam &param)
+#define BLYNK_WRITE(pin) BLYNK_WRITE_2(pin)
+
+class BlynkSim {
+public:
+  void config(const char* auth, const char* domain = "blynk.cloud", uint16_t port = 80);
+  bool connect(uint32_t timeout = 30000);
+  void disconnect();
+  bool connected();
+  void run();
+
+  void virtualWrite(int pin, const char* value);
+  void virtualWrite(int pin, int value);
+  void virtualWrite(int pin, long value);
+  void virtualWrite(int pin, double value);
+  void logEvent(const char* event, const char* description = "");
+  void beginGroup();
+  void beginGroup(uint64_t timestamp);
+  void endGroup();
+};
+
+extern BlynkSim Blynk;
+
+// SimpleTimer as bundled with Blynk
+class BlynkTimer {
+public:
+  typedef void (*timer_callback)();
+
+  int setInterval(unsigned long interval, timer_callback callback);
+  void run();
+
+private:
+  static const uint8_t MAX_TIMERS = 16;
+  struct Timer {
+    unsigned long interval;
+    unsigned long previous;
+    timer_callback callback;
+  };
+  Timer timers[MAX_TIMERS];
+  uint8_t count = 0;
+};
@@ -0,0 +1,35 @@
+// Host build: DS1302 library interface, served by the RTC model in
+// host/devices.cpp
+#pragma once
+
+#include <Arduino.h>
+
+#define MONDAY    1
+#define TUESDAY   2
+#define WEDNESDAY 3
+#define THURSDAY  4
+#define FRIDAY    5
+#define SATURDAY  6
+#define SUNDAY    7
+
+class Time {
+public:
+  uint8_t hour = 0;
+  uint8_t min = 0;
+  uint8_t sec = 0;
+  uint8_t date = 1;
+  uint8_t mon = 1;
+  uint16_t year = 2000;
+  uint8_t dow = SATURDAY;
+};
+
+class DS1302 {
+public:
+  DS1302(uint8_t ce, uint8_t data, uint8_t sclk) {}
+  Time getTime();
+  void setTime(uint8_t hour, uint8_t min, uint8_t sec);
+  void setDate(uint8_t date, uint8_t mon, uint16_t year);
+  void setDOW(uint8_t dow) {}   // Derived from the date here
+  void halt(bool value);
+  void writeProtect(bool enable) {}
+};
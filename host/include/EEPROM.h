@@ -0,0 +1,17 @@
+// Host build: ESP8266 EEPROM emulation, served by the model in
+// host/devices.cpp
+#pragma once
+
+#include <Arduino.h>
+
+class EEPROMClass {
+public:
+  void begin(size_t size);
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  bool commit();
+  void end() {}
+  size_t length();
+};
+
+extern EEPROMClass EEPROM;
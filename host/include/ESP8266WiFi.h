@@ -0,0 +1,57 @@
+// Host build: station-mode WiFi against the simulated access point
+// (host/network.cpp). Connect times follow the scenario options.
+#pragma once
+
+#include <Arduino.h>
+
+class IPAddress {
+public:
+  IPAddress(uint32_t address = 0) {
+    memcpy(bytes, &address, 4);
+  }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+
+  operator uint32_t() const {
+    uint32_t address;
+    memcpy(&address, bytes, 4);
+    return address;
+  }
+  uint8_t operator[](int index) const { return bytes[index]; }
+
+private:
+  uint8_t bytes[4];
+};
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1
+} WiFiMode_t;
+
+class WiFiClass {
+public:
+  void persistent(bool persistent) {}
+  bool mode(WiFiMode_t mode) { return true; }
+  wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0,
+                    const uint8_t* bssid = nullptr, bool connect = true);
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress());
+  bool disconnect(bool wifioff = false);
+  wl_status_t status();
+
+  uint8_t* BSSID();
+  int32_t channel();
+  int32_t RSSI();
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t index = 0);
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,33 @@
+// Host build: LiquidCrystal_I2C as the library implements it, every
+// nibble an expander write with EN pulsed, over the simulated bus.
+#pragma once
+
+#include <Wire.h>
+
+class LiquidCrystal_I2C : public Print {
+public:
+  LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows)
+    : address(address), cols(cols), rows(rows) {}
+
+  void init();
+  void clear();
+  void home();
+  void setCursor(uint8_t col, uint8_t row);
+  void backlight();
+  void noBacklight();
+  void createChar(uint8_t location, const uint8_t charmap[]);
+  void command(uint8_t value);
+  size_t write(uint8_t value) override;
+  using Print::write;
+
+private:
+  uint8_t address;
+  uint8_t cols;
+  uint8_t rows;
+  uint8_t backlightVal = 0x08;
+
+  void send(uint8_t value, uint8_t mode);
+  void write4bits(uint8_t value);
+  void expanderWrite(uint8_t data);
+  void pulseEnable(uint8_t data);
+};
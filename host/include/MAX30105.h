@@ -0,0 +1,37 @@
+// Host build: the SparkFun MAX3010x calls the sketch makes, as register
+// accesses on the simulated bus (the sensor model is in host/i2c.cpp).
+#pragma once
+
+#include <Wire.h>
+
+#define MAX30105_ADDRESS   0x57
+#define I2C_SPEED_STANDARD 100000
+#define I2C_SPEED_FAST     400000
+
+class MAX30105 {
+public:
+  bool begin(TwoWire &wirePort = Wire, uint32_t i2cSpeed = I2C_SPEED_STANDARD,
+             uint8_t i2caddr = MAX30105_ADDRESS);
+  void setup(uint8_t powerLevel = 0x1F, uint8_t sampleAverage = 4, uint8_t ledMode = 3,
+             int sampleRate = 400, int pulseWidth = 411, int adcRange = 4096);
+
+  void softReset();
+  void setPulseAmplitudeRed(uint8_t value);
+  void setPulseAmplitudeIR(uint8_t value);
+  void setFIFOAlmostFull(uint8_t samples);
+  void enableAFULL();
+  void clearFIFO();
+  uint8_t getReadPointer();
+  uint8_t getWritePointer();
+  uint8_t getINT1();
+  uint8_t readPartID();
+
+  uint8_t readRegister8(uint8_t address, uint8_t reg);
+  void writeRegister8(uint8_t address, uint8_t reg, uint8_t value);
+
+private:
+  TwoWire* i2cPort = &Wire;
+  uint8_t i2caddr = MAX30105_ADDRESS;
+
+  void bitMask(uint8_t reg, uint8_t mask, uint8_t thing);
+};
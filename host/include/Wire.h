@@ -0,0 +1,33 @@
+// Host build: TwoWire on top of the simulated bus (host/i2c.cpp). Like
+// the ESP8266 core, transfers are blocking and capped at BUFFER_LENGTH.
+#pragma once
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH 128
+
+class TwoWire {
+public:
+  void begin(int sda, int scl) {}
+  void begin() {}
+  void setClock(uint32_t frequency);
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t data);
+  size_t write(const uint8_t* data, size_t quantity);
+  uint8_t endTransmission(bool sendStop = true);
+
+  uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+  int available();
+  int read();
+
+private:
+  uint8_t txAddress = 0;
+  uint8_t txBuffer[BUFFER_LENGTH];
+  uint8_t txLength = 0;
+  uint8_t rxBuffer[BUFFER_LENGTH];
+  uint8_t rxLength = 0;
+  uint8_t rxIndex = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,6 @@
+// Host build: SparkFun's PBA beat detector (host/heartRate.cpp)
+#pragma once
+
+#include <Arduino.h>
+
+bool checkForBeat(int32_t sample);
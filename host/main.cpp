@@ -0,0 +1,19 @@
+// Runs the sketch against the simulated board: setup() once, then loop()
+// until the scenario's time is up, each pass charging --step-us of
+// virtual time on top of whatever the pass itself spent.
+#include <Arduino.h>
+#include "sim.h"
+
+void setup();
+void loop();
+
+int main(int argc, char** argv) {
+  if (!sim::begin(argc, argv)) return 2;
+  setup();
+  while (!sim::done()) {
+    loop();
+    sim::lcdPass();
+    sim::spend(sim::scenario.stepUs);
+  }
+  return sim::finish();
+}
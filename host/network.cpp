@@ -0,0 +1,510 @@
+// Network models: the access point behind WiFi and the Blynk server
+// behind the Blynk client, plus BlynkTimer.
+#include <BlynkSimpleEsp8266.h>
+#include "sim.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiClass WiFi;
+BlynkSim Blynk;
+
+namespace sim {
+namespace {
+
+// ----- Access point -----
+// A connect to a known BSSID and channel skips the scan; a static
+// address skips DHCP. The link drops when an outage window starts and
+// stays down until the next begin(); an attempt finishing inside an
+// outage (or with --no-wifi) never completes.
+const uint32_t WIFI_FAST_US = 400000;
+const uint32_t WIFI_SCAN_US = 2500000;
+const uint32_t WIFI_DHCP_US = 600000;
+const uint64_t NEVER = ~0ULL;
+
+uint64_t wifiUpAt = NEVER;       // When the current attempt completes
+uint32_t staticIp = 0;
+uint32_t wifiAttempts = 0;
+uint32_t wifiConnects = 0;
+uint32_t wifiDrops = 0;
+bool wifiUp = false;
+
+bool windowStarts(const std::vector<Window> &windows, uint64_t after, uint64_t until) {
+  for (const Window &w : windows) {
+    if (w.startUs > after && w.startUs <= until) return true;
+  }
+  return false;
+}
+
+bool linkUp() {
+  uint64_t now = nowUs();
+  if (wifiUpAt == NEVER || now < wifiUpAt) return false;
+  if (windowStarts(scenario.wifiDown, wifiUpAt, now)) {
+    wifiUpAt = NEVER;
+    wifiUp = false;
+    wifiDrops++;
+    log("wifi: link lost");
+    return false;
+  }
+  if (!wifiUp) {
+    wifiUp = true;
+    wifiConnects++;
+    log("wifi: link up");
+  }
+  return true;
+}
+
+// ----- Blynk server -----
+// The client logs in from run(): a TCP connect plus login every 5 s
+// while CONNECTING, answered after about 150 ms unless the server is
+// muted. A muted window starting also drops a running session, like a
+// server that stops answering heartbeats. Messages are sized as the
+// library builds them: "vw", pin and value as NUL-terminated strings in
+// a BLYNK_MAX_SENDBYTES buffer; a value that does not fit is left out.
+// Writes while not connected are dropped.
+enum BlynkState {
+  BLYNK_IDLE,
+  BLYNK_CONNECTING,
+  BLYNK_CONNECTED,
+  BLYNK_DISCONNECTED
+};
+
+const uint32_t BLYNK_RECONNECT_US = 5000000;
+const uint32_t BLYNK_LOGIN_US = 150000;
+const uint32_t BLYNK_RUN_US = 20;
+const uint8_t BLYNK_HEADER_BYTES = 5;
+
+uint8_t blynkState = BLYNK_IDLE;
+uint64_t blynkAttemptAt = NEVER;
+uint64_t blynkLoginAt = NEVER;    // When the pending login is answered
+uint64_t blynkSessionSince = 0;
+uint32_t blynkAttempts = 0;
+uint32_t blynkLogins = 0;
+uint32_t blynkSessionDrops = 0;
+uint32_t blynkMessages = 0;
+uint32_t blynkBytes = 0;
+uint32_t blynkOffline = 0;
+uint32_t blynkTruncated = 0;
+size_t appWritesDone = 0;
+std::string blynkAuth;
+
+const char* const BLYNK_STATE_NAMES[] = {"idle", "connecting", "connected", "disconnected"};
+
+void blynkSetState(uint8_t state) {
+  if (state == blynkState) return;
+  log("blynk: %s", BLYNK_STATE_NAMES[state]);
+  blynkState = state;
+}
+
+// ----- Real server (--server HOST:PORT) -----
+// Instead of answering logins itself, the model connects to a server on
+// the host, such as tools/blynk_server.py, and speaks the hardware
+// protocol: a 5-byte header (command, message id, length), the auth
+// token as login, a ping every heartbeat and NUL-separated "vw" writes
+// both ways. Group markers stay local. Virtual time is paced to host
+// time meanwhile (see spend()), so the server's timings hold.
+const uint8_t CMD_RESPONSE = 0;
+const uint8_t CMD_PING = 6;
+const uint8_t CMD_HARDWARE = 20;
+const uint8_t CMD_HW_LOGIN = 29;
+const uint8_t CMD_EVENT = 64;
+const uint16_t STATUS_OK = 200;
+const uint64_t BLYNK_HEARTBEAT_US = 45000000;
+
+int serverFd = -1;
+uint16_t serverMsgId = 0;
+uint16_t serverLoginId = 0;
+bool serverLoggedIn = false;
+uint64_t serverPingAt = 0;
+uint8_t serverRx[1024];
+size_t serverRxLen = 0;
+
+void serverClose() {
+  if (serverFd >= 0) close(serverFd);
+  serverFd = -1;
+  serverLoggedIn = false;
+  serverRxLen = 0;
+}
+
+void serverSend(uint8_t cmd, const char* body, size_t length, uint16_t id = 0) {
+  if (serverFd < 0) return;
+  if (id == 0) {
+    serverMsgId = serverMsgId % 0xFFFF + 1;
+    id = serverMsgId;
+  }
+  uint8_t frame[5 + BLYNK_MAX_SENDBYTES];
+  if (length > BLYNK_MAX_SENDBYTES) length = BLYNK_MAX_SENDBYTES;
+  frame[0] = cmd;
+  frame[1] = id >> 8;
+  frame[2] = id;
+  frame[3] = length >> 8;
+  frame[4] = length;
+  memcpy(frame + 5, body, length);
+  if (send(serverFd, frame, 5 + length, MSG_NOSIGNAL) != (ssize_t)(5 + length)) serverClose();
+}
+
+void serverOpen() {
+  serverClose();
+  std::string host = scenario.server.substr(0, scenario.server.rfind(':'));
+  std::string port = scenario.server.substr(scenario.server.rfind(':') + 1);
+  addrinfo hints = {};
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* found = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) {
+    log("blynk: cannot resolve %s", scenario.server.c_str());
+    return;
+  }
+  serverFd = socket(found->ai_family, SOCK_STREAM, 0);
+  if (serverFd >= 0 && connect(serverFd, found->ai_addr, found->ai_addrlen) != 0) {
+    log("blynk: cannot connect to %s: %s", scenario.server.c_str(), strerror(errno));
+    serverClose();
+  }
+  freeaddrinfo(found);
+  if (serverFd < 0) return;
+  fcntl(serverFd, F_SETFL, fcntl(serverFd, F_GETFL) | O_NONBLOCK);
+  serverSend(CMD_HW_LOGIN, blynkAuth.c_str(), blynkAuth.size());
+  serverLoginId = serverMsgId;
+  serverPingAt = nowUs() + BLYNK_HEARTBEAT_US;
+}
+
+void blynkDeliver(uint8_t pin, const char* value) {
+  char buffer[64];
+  BlynkParam param(buffer, 0, sizeof(buffer));
+  param.add(value);
+  BlynkReq request = {pin};
+  if (scenario.showBlynk) log("blynk < vw %u %s", pin, value);
+  WidgetWriteHandler handler = GetWriteHandler(pin);
+  if (handler) handler(request, param);
+}
+
+// Reads what the server sent; false once it has closed the connection
+bool serverPoll() {
+  if (serverFd < 0) return false;
+  ssize_t n = recv(serverFd, serverRx + serverRxLen, sizeof(serverRx) - serverRxLen, 0);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    serverClose();
+    return false;
+  }
+  if (n > 0) serverRxLen += n;
+
+  size_t used = 0;
+  while (serverRxLen - used >= 5) {
+    const uint8_t* frame = serverRx + used;
+    uint8_t cmd = frame[0];
+    uint16_t id = frame[1] << 8 | frame[2];
+    uint16_t length = frame[3] << 8 | frame[4];
+    if (cmd == CMD_RESPONSE) {
+      // The length field carries the status
+      if (id == serverLoginId && length == STATUS_OK) serverLoggedIn = true;
+      used += 5;
+      continue;
+    }
+    if (length > sizeof(serverRx) - 5) {
+      serverClose();
+      return false;
+    }
+    if (serverRxLen - used < 5u + length) break;
+
+    if (cmd == CMD_PING) {
+      uint8_t ok[5] = {CMD_RESPONSE, frame[1], frame[2], STATUS_OK >> 8, STATUS_OK & 0xFF};
+      send(serverFd, ok, sizeof(ok), MSG_NOSIGNAL);
+    } else if (cmd == CMD_HARDWARE && length > 3 && memcmp(frame + 5, "vw", 3) == 0) {
+      std::string body((const char*)frame + 5, length);
+      size_t valueAt = body.find('\0', 3);
+      if (valueAt != std::string::npos) {
+        blynkDeliver(atoi(body.c_str() + 3), body.c_str() + valueAt + 1);
+      }
+    }
+    used += 5 + length;
+  }
+  memmove(serverRx, serverRx + used, serverRxLen - used);
+  serverRxLen -= used;
+  return serverFd >= 0;
+}
+
+void serverHeartbeat() {
+  if (serverFd < 0 || nowUs() < serverPingAt) return;
+  serverPingAt = nowUs() + BLYNK_HEARTBEAT_US;
+  serverSend(CMD_PING, "", 0);
+}
+
+// Fields are NUL-separated; returns false when the client would drop it
+bool blynkSend(const char* command, int pin, const char* value) {
+  if (blynkState != BLYNK_CONNECTED) {
+    blynkOffline++;
+    return false;
+  }
+
+  size_t length = strlen(command) + 1;
+  char pinText[12] = "";
+  if (pin >= 0) {
+    snprintf(pinText, sizeof(pinText), "%d", pin);
+    length += strlen(pinText) + 1;
+  }
+  size_t valueLength = value ? strlen(value) + 1 : 0;
+  if (length + valueLength > BLYNK_MAX_SENDBYTES) {
+    blynkTruncated++;
+    log("blynk: %s %s: %zu byte value does not fit in BLYNK_MAX_SENDBYTES, dropped",
+      command, pinText, valueLength - 1);
+    valueLength = 0;
+  } else {
+    length += valueLength;
+  }
+
+  blynkMessages++;
+  blynkBytes += BLYNK_HEADER_BYTES + length;
+  if (scenario.showBlynk) {
+    log("blynk > %s %s %s", command, pinText, valueLength ? value : "");
+  }
+
+  if (serverFd >= 0) {
+    std::string body;
+    uint8_t cmd = CMD_HARDWARE;
+    if (strncmp(command, "event ", 6) == 0) {
+      cmd = CMD_EVENT;
+      body = command + 6;
+    } else if (strcmp(command, "vw") == 0) {
+      body = std::string("vw") + '\0' + pinText;
+    } else {
+      return true;
+    }
+    if (valueLength) body += '\0' + std::string(value);
+    serverSend(cmd, body.data(), body.size());
+  }
+  return true;
+}
+
+void blynkDispatchAppWrites() {
+  uint64_t now = nowUs();
+  while (appWritesDone < scenario.appWrites.size() && scenario.appWrites[appWritesDone].atUs <= now) {
+    const AppWrite &w = scenario.appWrites[appWritesDone++];
+    blynkDeliver(w.pin, w.value.c_str());
+  }
+}
+
+}  // namespace
+
+void networkReport() {
+  log("wifi %u attempts, %u connects, %u drops", wifiAttempts, wifiConnects, wifiDrops);
+  log("blynk %s, %u login attempts, %u logins, %u sessions dropped",
+    BLYNK_STATE_NAMES[blynkState], blynkAttempts, blynkLogins, blynkSessionDrops);
+  log("blynk %u messages, %u bytes, %u dropped offline, %u values too long", blynkMessages,
+    blynkBytes, blynkOffline, blynkTruncated);
+}
+
+}  // namespace sim
+
+// ----- WiFi -----
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase, int32_t channel,
+                             const uint8_t* bssid, bool connect) {
+  using namespace sim;
+  wifiAttempts++;
+  wifiUp = false;
+  uint64_t now = nowUs();
+  uint64_t takes = channel && bssid ? WIFI_FAST_US : WIFI_SCAN_US;
+  if (!staticIp) takes += WIFI_DHCP_US;
+  wifiUpAt = now + takes;
+  if (!scenario.wifi || inWindow(scenario.wifiDown, wifiUpAt)) wifiUpAt = NEVER;
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1) {
+  sim::staticIp = local;
+  return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff) {
+  sim::wifiUpAt = sim::NEVER;
+  sim::wifiUp = false;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  return sim::linkUp() ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+uint8_t* WiFiClass::BSSID() {
+  static uint8_t bssid[6] = {0x24, 0x0A, 0xC4, 0x12, 0x34, 0x56};
+  return bssid;
+}
+
+int32_t WiFiClass::channel() {
+  return 6;
+}
+
+int32_t WiFiClass::RSSI() {
+  return sim::linkUp() ? -58 : 31;
+}
+
+IPAddress WiFiClass::localIP() {
+  if (!sim::linkUp()) return IPAddress();
+  return sim::staticIp ? IPAddress(sim::staticIp) : IPAddress(192, 168, 1, 57);
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  return IPAddress(192, 168, 1, 1);
+}
+
+IPAddress WiFiClass::subnetMask() {
+  return IPAddress(255, 255, 255, 0);
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t index) {
+  return IPAddress(192, 168, 1, 1);
+}
+
+// ----- Blynk -----
+void BlynkSim::config(const char* auth, const char* domain, uint16_t port) {
+  sim::blynkAuth = auth;
+  sim::blynkSetState(sim::BLYNK_CONNECTING);
+}
+
+// As in the library: re-arms the login, then runs until connected or
+// the timeout passes. connect(0) only re-arms.
+bool BlynkSim::connect(uint32_t timeout) {
+  sim::blynkSetState(sim::BLYNK_CONNECTING);
+  sim::blynkAttemptAt = sim::NEVER;
+  sim::blynkLoginAt = sim::NEVER;
+  unsigned long started = millis();
+  while (!connected() && millis() - started < timeout) run();
+  return connected();
+}
+
+void BlynkSim::disconnect() {
+  sim::serverClose();
+  sim::blynkLoginAt = sim::NEVER;
+  sim::blynkSetState(sim::BLYNK_DISCONNECTED);
+}
+
+bool BlynkSim::connected() {
+  return sim::blynkState == sim::BLYNK_CONNECTED;
+}
+
+void BlynkSim::run() {
+  using namespace sim;
+  spend(BLYNK_RUN_US);
+  if (blynkState == BLYNK_IDLE || blynkState == BLYNK_DISCONNECTED) return;
+  uint64_t now = nowUs();
+  bool link = WiFi.status() == WL_CONNECTED;
+
+  bool real = !scenario.server.empty();
+
+  if (blynkState == BLYNK_CONNECTED) {
+    bool up = real ? serverPoll() : !windowStarts(scenario.blynkMute, blynkSessionSince, now);
+    if (link && up) {
+      blynkDispatchAppWrites();
+      serverHeartbeat();
+      return;
+    }
+    serverClose();
+    blynkSessionDrops++;
+    blynkAttemptAt = NEVER;
+    blynkLoginAt = NEVER;
+    blynkSetState(BLYNK_CONNECTING);
+  }
+
+  if (!link) return;
+  if (real && serverPoll() && serverLoggedIn) blynkLoginAt = now;
+  if (blynkLoginAt != NEVER && now >= blynkLoginAt) {
+    blynkLogins++;
+    blynkLoginAt = NEVER;
+    blynkSessionSince = now;
+    blynkSetState(BLYNK_CONNECTED);
+    return;
+  }
+  if (blynkAttemptAt == NEVER || now - blynkAttemptAt >= BLYNK_RECONNECT_US) {
+    blynkAttempts++;
+    blynkAttemptAt = now;
+    if (real) {
+      serverOpen();
+      blynkLoginAt = NEVER;
+    } else {
+      blynkLoginAt = inWindow(scenario.blynkMute, now) ? NEVER : now + BLYNK_LOGIN_US;
+    }
+  }
+}
+
+void BlynkSim::virtualWrite(int pin, const char* value) {
+  sim::blynkSend("vw", pin, value);
+}
+
+void BlynkSim::virtualWrite(int pin, int value) {
+  virtualWrite(pin, (long)value);
+}
+
+void BlynkSim::virtualWrite(int pin, long value) {
+  char text[16];
+  snprintf(text, sizeof(text), "%ld", value);
+  sim::blynkSend("vw", pin, text);
+}
+
+void BlynkSim::virtualWrite(int pin, double value) {
+  char text[24];
+  snprintf(text, sizeof(text), "%.3f", value);
+  sim::blynkSend("vw", pin, text);
+}
+
+void BlynkSim::logEvent(const char* event, const char* description) {
+  char text[BLYNK_MAX_SENDBYTES * 2];
+  snprintf(text, sizeof(text), "%s", description);
+  char command[48];
+  snprintf(command, sizeof(command), "event %s", event);
+  sim::blynkSend(command, -1, text);
+}
+
+void BlynkSim::beginGroup() {
+  sim::blynkSend("group", -1, nullptr);
+}
+
+void BlynkSim::beginGroup(uint64_t timestamp) {
+  char text[24];
+  snprintf(text, sizeof(text), "%llu", (unsigned long long)timestamp);
+  sim::blynkSend("group", -1, text);
+}
+
+void BlynkSim::endGroup() {
+  sim::blynkSend("group_end", -1, nullptr);
+}
+
+// ----- BLYNK_WRITE handlers -----
+// Weak references: pins without a BLYNK_WRITE() resolve to nullptr
+#define BLYNK_HANDLERS(X) \
+  X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) \
+  X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) \
+  X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) \
+  X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31) \
+  X(32) X(33) X(34) X(35) X(36) X(37) X(38) X(39) \
+  X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) \
+  X(48) X(49) X(50) X(51) X(52) X(53) X(54) X(55) \
+  X(56) X(57) X(58) X(59) X(60) X(61) X(62) X(63)
+
+#define X(pin) void BlynkWidgetWrite ## pin(BlynkReq &request, const BlynkParam &param) __attribute__((weak));
+BLYNK_HANDLERS(X)
+#undef X
+
+WidgetWriteHandler GetWriteHandler(uint8_t pin) {
+#define X(pin) BlynkWidgetWrite ## pin,
+  static const WidgetWriteHandler HANDLERS[] = {BLYNK_HANDLERS(X)};
+#undef X
+  return pin < sizeof(HANDLERS) / sizeof(HANDLERS[0]) ? HANDLERS[pin] : nullptr;
+}
+
+// ----- BlynkTimer -----
+int BlynkTimer::setInterval(unsigned long interval, timer_callback callback) {
+  if (count == MAX_TIMERS) return -1;
+  timers[count] = {interval, millis(), callback};
+  return count++;
+}
+
+void BlynkTimer::run() {
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < count; i++) {
+    if (now - timers[i].previous < timers[i].interval) continue;
+    timers[i].previous += timers[i].interval;
+    timers[i].callback();
+  }
+}
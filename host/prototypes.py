@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+"""Turns the sketch into a C++ translation unit the way the Arduino
+builder does: Arduino.h first, then a prototype for every function,
+inserted ahead of the first function definition. #line directives keep
+compiler messages pointing at the sketch.
+
+  prototypes.py SKETCH OUT
+"""
+import re
+import sys
+
+DEFINITION = re.compile(
+    r"^(?!BLYNK_|static |struct |class |enum |typedef |template|else|if|for|while|switch|return)"
+    r"([A-Za-z_][\w:<>\*&\s]*?[\s\*&])(\w+)\s*\(([^;{}]*)\)\s*\{\s*$")
+
+
+def main():
+    sketch, out = sys.argv[1], sys.argv[2]
+    lines = open(sketch, encoding="utf-8").read().split("\n")
+
+    prototypes = []
+    first = None
+    for i, line in enumerate(lines):
+        m = DEFINITION.match(line)
+        if not m:
+            continue
+        if first is None:
+            first = i
+        if m.group(2) not in ("setup", "loop"):
+            prototypes.append(line.rstrip()[:-1].rstrip() + ";")
+    if first is None:
+        first = 0
+
+    with open(out, "w", encoding="utf-8") as f:
+        f.write("#include <Arduino.h>\n")
+        f.write('#line 1 "%s"\n' % sketch)
+        f.write("\n".join(lines[:first]) + "\n")
+        f.write("\n".join(prototypes) + "\n")
+        f.write('#line %d "%s"\n' % (first + 1, sketch))
+        f.write("\n".join(lines[first:]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,416 @@
+// Host simulator core: virtual clock, pins and interrupts, Serial, ESP
+// and the scenario options. The peripheral models live in devices.cpp
+// (RTC, DHT11, button, buzzer, EEPROM), i2c.cpp (MAX30102, LCD backpack)
+// and network.cpp (WiFi, Blynk).
+#include <Arduino.h>
+#include "sim.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <malloc.h>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace sim {
+
+Scenario scenario;
+
+namespace {
+
+uint64_t clockUs = 0;
+const auto hostStart = std::chrono::steady_clock::now();
+
+const uint8_t PIN_COUNT = 17;
+
+struct Pin {
+  uint8_t mode = INPUT;
+  bool output = LOW;     // Driven by the sketch
+  bool input = HIGH;     // Driven by a model, or the pull-up
+  void (*isr)() = nullptr;
+  int isrMode = 0;
+};
+
+Pin pins[PIN_COUNT];
+
+struct PinEvent {
+  uint8_t pin;
+  bool level;
+};
+
+std::multimap<uint64_t, PinEvent> pinEvents;
+
+uint64_t hostUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - hostStart).count();
+}
+
+void applyPinEvent(const PinEvent &e) {
+  Pin &p = pins[e.pin];
+  bool old = p.input;
+  p.input = e.level;
+  if (!p.isr || old == e.level) return;
+  if (p.isrMode == CHANGE || (p.isrMode == FALLING && !e.level) || (p.isrMode == RISING && e.level)) {
+    p.isr();
+  }
+}
+
+}  // namespace
+
+bool inWindow(const std::vector<Window> &windows, uint64_t us) {
+  for (const Window &w : windows) {
+    if (us >= w.startUs && us < w.endUs) return true;
+  }
+  return false;
+}
+
+uint64_t nowUs() {
+  return clockUs;
+}
+
+double hostSeconds() {
+  return hostUs() / 1e6;
+}
+
+void spend(uint64_t us) {
+  uint64_t target = clockUs + us;
+  while (!pinEvents.empty() && pinEvents.begin()->first <= target) {
+    auto it = pinEvents.begin();
+    if (it->first > clockUs) clockUs = it->first;
+    PinEvent e = it->second;
+    pinEvents.erase(it);
+    applyPinEvent(e);
+  }
+  clockUs = target;
+
+  // A real server keeps real time, so virtual time may not run ahead
+  if (!scenario.server.empty() && clockUs > hostUs() + 1000) usleep(clockUs - hostUs());
+}
+
+void schedulePin(uint64_t atUs, uint8_t pin, bool level) {
+  if (pin < PIN_COUNT) pinEvents.emplace(atUs, PinEvent{pin, level});
+}
+
+uint8_t pinModeOf(uint8_t pin) {
+  return pin < PIN_COUNT ? pins[pin].mode : INPUT;
+}
+
+bool pinOutput(uint8_t pin) {
+  return pin < PIN_COUNT && pins[pin].output;
+}
+
+void log(const char* format, ...) {
+  char text[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  uint64_t us = nowUs();
+  fprintf(stdout, "[SIM %llu.%03llu] %s\n", (unsigned long long)(us / 1000000),
+    (unsigned long long)(us / 1000 % 1000), text);
+}
+
+// ----- Options -----
+namespace {
+
+void usage() {
+  fprintf(stderr,
+    "usage: clock [options]\n"
+    "  --seconds N            virtual run time (default 60)\n"
+    "  --uptime N             board time at the start, in seconds: millis()\n"
+    "                         and micros() read as if powered on N s earlier\n"
+    "  --step-us N            virtual time per loop() pass (default 100)\n"
+    "  --rtc 'Y-M-D h:m:s'    RTC time at power-on\n"
+    "  --rtc-step S:SECONDS   set the RTC forward (or back) at second S\n"
+    "  --dht FILE             DHT11 script: '<s> <temp C> <humidity %%>',\n"
+    "                         '<s> timeout' or '<s> checksum' per line\n"
+    "  --finger A-B[@BPM]     finger on the MAX30102 from second A to B\n"
+    "  --ppg FILE             MAX30102 samples from a trace (tools/trace.py)\n"
+    "  --press S[:MS]         button press at second S, held MS (default 100)\n"
+    "  --no-wifi              the access point never answers\n"
+    "  --wifi-down A-B        WiFi outage from second A to B\n"
+    "  --blynk-mute A-B       Blynk server ignores logins from A to B\n"
+    "  --app S:PIN:VALUE      app writes VALUE to virtual pin PIN at second S\n"
+    "  --eeprom FILE          EEPROM image, loaded at boot, saved on commit\n"
+    "  --server HOST:PORT     talk to a real Blynk server (tools/blynk_server.py)\n"
+    "                         instead of the model; runs in real time\n"
+    "  --lcd                  print the LCD whenever it changes\n"
+    "  --blynk                print every Blynk message\n");
+}
+
+uint64_t secondsToUs(const char* s) {
+  return (uint64_t)(atof(s) * 1000000);
+}
+
+bool parseWindow(const char* s, Window &w) {
+  const char* dash = strchr(s, '-');
+  if (!dash) return false;
+  w.startUs = secondsToUs(s);
+  w.endUs = secondsToUs(dash + 1);
+  return w.endUs > w.startUs;
+}
+
+}  // namespace
+
+bool begin(int argc, char** argv) {
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  fcntl(0, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
+
+  for (int i = 1; i < argc; i++) {
+    const char* opt = argv[i];
+    const char* arg = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool used = true;
+
+    if (strcmp(opt, "--no-wifi") == 0) {
+      scenario.wifi = false;
+      used = false;
+    } else if (strcmp(opt, "--lcd") == 0) {
+      scenario.showLcd = true;
+      used = false;
+    } else if (strcmp(opt, "--blynk") == 0) {
+      scenario.showBlynk = true;
+      used = false;
+    } else if (!arg) {
+      usage();
+      return false;
+    } else if (strcmp(opt, "--seconds") == 0) {
+      scenario.seconds = atof(arg);
+    } else if (strcmp(opt, "--uptime") == 0) {
+      scenario.uptimeUs = secondsToUs(arg);
+    } else if (strcmp(opt, "--step-us") == 0) {
+      scenario.stepUs = atoi(arg);
+    } else if (strcmp(opt, "--rtc") == 0) {
+      scenario.rtcStart = arg;
+    } else if (strcmp(opt, "--rtc-step") == 0) {
+      const char* colon = strchr(arg, ':');
+      if (!colon) { usage(); return false; }
+      scenario.rtcSteps.push_back({secondsToUs(arg), atoi(colon + 1)});
+    } else if (strcmp(opt, "--dht") == 0) {
+      scenario.dhtScript = arg;
+    } else if (strcmp(opt, "--ppg") == 0) {
+      scenario.ppgTrace = arg;
+    } else if (strcmp(opt, "--finger") == 0) {
+      Finger f = {{0, 0}, 72};
+      if (!parseWindow(arg, f.when)) { usage(); return false; }
+      const char* at = strchr(arg, '@');
+      if (at) f.bpm = atoi(at + 1);
+      scenario.fingers.push_back(f);
+    } else if (strcmp(opt, "--press") == 0) {
+      const char* colon = strchr(arg, ':');
+      scenario.presses.push_back({secondsToUs(arg), colon ? (uint32_t)atoi(colon + 1) : 100});
+    } else if (strcmp(opt, "--wifi-down") == 0) {
+      Window w;
+      if (!parseWindow(arg, w)) { usage(); return false; }
+      scenario.wifiDown.push_back(w);
+    } else if (strcmp(opt, "--blynk-mute") == 0) {
+      Window w;
+      if (!parseWindow(arg, w)) { usage(); return false; }
+      scenario.blynkMute.push_back(w);
+    } else if (strcmp(opt, "--app") == 0) {
+      const char* c1 = strchr(arg, ':');
+      const char* c2 = c1 ? strchr(c1 + 1, ':') : nullptr;
+      if (!c2) { usage(); return false; }
+      scenario.appWrites.push_back({secondsToUs(arg), (uint8_t)atoi(c1 + 1), c2 + 1});
+    } else if (strcmp(opt, "--eeprom") == 0) {
+      scenario.eepromFile = arg;
+    } else if (strcmp(opt, "--server") == 0) {
+      if (!strchr(arg, ':')) { usage(); return false; }
+      scenario.server = arg;
+    } else {
+      usage();
+      return false;
+    }
+    if (used) i++;
+  }
+
+  ESP.getFreeHeap();   // Heap figures count from here
+  devicesBegin();
+  i2cBegin();
+  return true;
+}
+
+bool done() {
+  return nowUs() >= (uint64_t)(scenario.seconds * 1000000);
+}
+
+int finish() {
+  uint64_t us = nowUs();
+  log("%.3f s virtual in %.3f s host", us / 1e6, hostUs() / 1e6);
+  devicesReport();
+  i2cReport();
+  networkReport();
+  log("lcd |%s|%s|", lcdText(0).c_str(), lcdText(1).c_str());
+  return 0;
+}
+
+}  // namespace sim
+
+// ----- Arduino core -----
+unsigned long millis() {
+  return (unsigned long)(uint32_t)((sim::nowUs() + sim::scenario.uptimeUs) / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)(uint32_t)(sim::nowUs() + sim::scenario.uptimeUs);
+}
+
+void delay(unsigned long ms) {
+  sim::spend((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::spend(us);
+}
+
+void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= sim::PIN_COUNT) return;
+  sim::pins[pin].mode = mode;
+  sim::devicesPinChanged(pin);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= sim::PIN_COUNT) return;
+  sim::pins[pin].output = value;
+  sim::devicesPinChanged(pin);
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin >= sim::PIN_COUNT) return LOW;
+  const sim::Pin &p = sim::pins[pin];
+  return p.mode == OUTPUT ? p.output : p.input;
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+  if (pin >= sim::PIN_COUNT) return;
+  sim::pins[pin].isr = isr;
+  sim::pins[pin].isrMode = mode;
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < sim::PIN_COUNT) sim::pins[pin].isr = nullptr;
+}
+
+void noInterrupts() {}
+void interrupts() {}
+
+size_t Print::printf(const char* format, ...) {
+  char text[512];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  return write((const uint8_t*)text, (size_t)len < sizeof(text) ? len : sizeof(text) - 1);
+}
+
+// ----- Serial -----
+// Output goes to stdout. The UART model charges the time the real one
+// would block: the 128-byte TX FIFO drains at baud / 10 bytes per second
+// and a write into a full FIFO waits for a free slot. Input is read
+// from stdin without blocking, so commands or a trace can be piped in.
+namespace {
+
+const uint32_t UART_FIFO = 128;
+uint32_t uartBaud = 115200;
+uint64_t uartIdleAt = 0;      // When the FIFO will have drained
+uint8_t rxBuffer[4096];
+size_t rxLen = 0;
+size_t rxPos = 0;
+
+void uartCharge(size_t bytes) {
+  uint64_t byteUs = 10000000ULL / uartBaud;
+  for (size_t i = 0; i < bytes; i++) {
+    uint64_t now = sim::nowUs();
+    if (uartIdleAt < now) uartIdleAt = now;
+    uint64_t queued = (uartIdleAt - now) / byteUs;
+    if (queued >= UART_FIFO) sim::spend(uartIdleAt - now - (UART_FIFO - 1) * byteUs);
+    uartIdleAt += byteUs;
+  }
+}
+
+}  // namespace
+
+void HardwareSerial::begin(unsigned long baud) {
+  uartBaud = baud;
+}
+
+int HardwareSerial::available() {
+  if (rxPos == rxLen) {
+    ssize_t n = ::read(0, rxBuffer, sizeof(rxBuffer));
+    rxPos = 0;
+    rxLen = n > 0 ? n : 0;
+  }
+  return rxLen - rxPos;
+}
+
+int HardwareSerial::read() {
+  return available() ? rxBuffer[rxPos++] : -1;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  fwrite(buffer, 1, size, stdout);
+  uartCharge(size);
+  return size;
+}
+
+// ----- ESP -----
+// Heap figures follow the host allocator: free heap is a nominal 40 KB
+// minus whatever the sketch has allocated since boot.
+namespace {
+
+const uint32_t HEAP_SIZE = 40960;
+size_t heapBase = 0;
+uint8_t rtcUserMemory[512];
+
+size_t heapUsed() {
+  size_t used = mallinfo2().uordblks;
+  if (heapBase == 0) heapBase = used;
+  return used > heapBase ? used - heapBase : 0;
+}
+
+}  // namespace
+
+uint32_t EspClass::getCycleCount() {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - sim::hostStart).count();
+  return (uint32_t)(ns * 80 / 1000);
+}
+
+uint32_t EspClass::getFreeHeap() {
+  size_t used = heapUsed();
+  return used < HEAP_SIZE ? HEAP_SIZE - used : 0;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize() {
+  return getFreeHeap();
+}
+
+uint8_t EspClass::getHeapFragmentation() {
+  return 0;
+}
+
+uint32_t EspClass::getSketchSize() {
+  struct stat st;
+  return stat("/proc/self/exe", &st) == 0 ? st.st_size : 0;
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) {
+  if (offset * 4 + size > sizeof(rtcUserMemory)) return false;
+  memcpy(data, rtcUserMemory + offset * 4, size);
+  return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+  if (offset * 4 + size > sizeof(rtcUserMemory)) return false;
+  memcpy(rtcUserMemory + offset * 4, data, size);
+  return true;
+}
@@ -0,0 +1,109 @@
+// Host simulator internals shared by the peripheral models.
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+// ----- Scenario, from the command line (see usage() in sim.cpp) -----
+struct Window {
+  uint64_t startUs;
+  uint64_t endUs;
+};
+
+struct Finger {
+  Window when;
+  uint16_t bpm;
+};
+
+struct Press {
+  uint64_t atUs;
+  uint32_t holdMs;
+};
+
+struct RtcStep {
+  uint64_t atUs;
+  int32_t seconds;
+};
+
+struct AppWrite {
+  uint64_t atUs;
+  uint8_t pin;
+  std::string value;
+};
+
+struct Scenario {
+  double seconds = 60;
+  uint32_t stepUs = 100;          // Virtual time per loop() pass
+  std::string rtcStart = "2024-02-26 08:00:00";
+  std::vector<RtcStep> rtcSteps;
+  std::string dhtScript;
+  std::string ppgTrace;
+  std::vector<Finger> fingers;
+  std::vector<Press> presses;
+  bool wifi = true;
+  std::vector<Window> wifiDown;
+  std::vector<Window> blynkMute;  // Server ignores logins, drops sessions
+  std::vector<AppWrite> appWrites;
+  std::string eepromFile;
+  std::string server;             // HOST:PORT of a real Blynk server
+  uint64_t uptimeUs = 0;          // Board time already gone at the start
+  bool showLcd = false;
+  bool showBlynk = false;
+};
+
+extern Scenario scenario;
+
+bool inWindow(const std::vector<Window> &windows, uint64_t us);
+
+// ----- Virtual clock -----
+// micros()/millis() only advance through spend(): the per-pass step in
+// main(), delay(), and the time the models charge for bus and peripheral
+// work. Host CPU time is not counted, so runs are deterministic;
+// ESP.getCycleCount() reports host CPU time instead (80 MHz ticks).
+// With --server, spend() waits whenever virtual time gets ahead of host
+// time, so a real server sees the sketch in real time. millis() and
+// micros() read board time: virtual time plus --uptime, so a run can
+// start just before they wrap.
+uint64_t nowUs();
+void spend(uint64_t us);
+double hostSeconds();
+
+// ----- Pins -----
+// Models drive input pins through scheduled edges, which fire any
+// attached interrupt with the clock set to the edge time
+void schedulePin(uint64_t atUs, uint8_t pin, bool level);
+uint8_t pinModeOf(uint8_t pin);
+bool pinOutput(uint8_t pin);      // Level the sketch drives
+
+// ----- Model hooks, called by the core -----
+void devicesBegin();
+void devicesPinChanged(uint8_t pin);
+void devicesReport();
+void i2cBegin();
+void i2cReport();
+void networkReport();
+
+// Visible LCD text, one line per row; custom glyphs show as '#'
+std::string lcdText(uint8_t row);
+
+// Called after every loop() pass: prints the LCD with --lcd if it changed
+void lcdPass();
+
+// Inputs a driver such as soak.cpp adds while running, on top of the
+// command line: a button press, and a DHT11 reading from atUs on
+// (in 0.1 units; add them in time order)
+void press(uint64_t atUs, uint32_t holdMs);
+void dhtReading(uint64_t atUs, int16_t temperature, int16_t humidity);
+
+// Messages from the simulator, marked so they stand apart from the sketch
+void log(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+// Parses the command line; false on a usage error
+bool begin(int argc, char** argv);
+bool done();
+int finish();
+
+}  // namespace sim
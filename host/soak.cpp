@@ -0,0 +1,263 @@
+// Soak test: a week of firmware time on the simulated board, in seconds.
+// The sketch runs unchanged against the models in devices.cpp, i2c.cpp
+// and network.cpp, with loop() passes 250 ms of virtual time apart;
+// this driver feeds the scenario as the days go by and checks after
+// every pass that:
+//   - each alarm rings at its minute, on its days and nowhere else,
+//     through midnight, the leap day and the millis() wrap, and stops on
+//     the button or after ALARM_DURATION
+//   - temperature warnings keep coming during a heat spell but never
+//     closer together than the temp_high rule's cooldown
+//   - the LCD's time page is never more than a second stale
+//   - the clock never steps back and stays within a second or two of the
+//     RTC
+//
+//   build/soak [--days N] [simulator options]
+//
+// The run starts two minutes before midnight ahead of a leap day, with
+// millis() 30 min from wrapping (--uptime); the boot lines therefore
+// count from an uptime of 49.7 days. The modelled day: 24.0-30.0 C rising
+// to noon and falling again, a 36.5 C heat spell 12:00-12:03, a finger
+// on the sensor 08:00-08:05 at 72 BPM. Every other alarm is stopped by a
+// button press 5 s in. Prints a report per calendar day, the speedup of
+// virtual over host time, and exits 1 if any check failed.
+//
+// The sketch is compiled into this file so its globals are at hand.
+#include "sketch.cpp"
+#include "sim.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint32_t DEFAULT_DAYS = 7;
+const uint32_t STEP_MS = 250;
+const char* const START_TIME = "2024-02-26 23:58:00";   // A Monday
+const uint32_t START_EPOCH = 762307080;                  // The same, since 2000
+const uint64_t UPTIME_MS = 0x100000000ULL - 30 * 60000ULL;
+const uint8_t FAIL_LOG = 20;                // Failures printed in full
+const uint32_t PRESS_DELAY = 5000;          // ms into a ring
+const uint64_t DHT_STEP_US = 60000000;      // The curve, a point a minute
+
+uint32_t days = DEFAULT_DAYS;
+uint32_t failures = 0;
+uint64_t nextDhtUs = 0;
+
+std::vector<uint8_t> expectedDay;           // Rings per calendar day of the run
+uint16_t expectedRings = 0;
+uint16_t rings = 0;
+bool wasRinging = false;
+uint64_t ringStartUs = 0;
+bool pressed = false;                       // This ring gets a press
+
+uint32_t warnings = 0;
+unsigned long lastWarning = 0;
+
+uint32_t lastEpoch = 0;
+uint64_t displayFreshUs = 0;                // Last pass the time page was right
+
+uint32_t calendarDay = 0;
+uint16_t day = 0;
+uint16_t dayRings = 0;
+uint16_t dayWarnings = 0;
+int dayHeartRate = 0;                       // Highest reading of the day
+
+void fail(const char* what) {
+  failures++;
+  if (failures > FAIL_LOG) return;
+  const Time &t = clockNow();
+  printf("[SOAK] FAIL day %u %02d:%02d:%02d %s\n", day, t.hour, t.min, t.sec, what);
+}
+
+// 0.1 C at a second of the day
+int16_t modelTemperature(uint32_t daySecond) {
+  if (daySecond >= 43200 && daySecond < 43200 + 180) return 365;
+  return daySecond < 43200 ? 240 + daySecond * 60 / 43200 : 300 - (daySecond - 43200) * 60 / 43200;
+}
+
+// Adds the temperature curve a minute ahead; the heat spell gets its own
+// points so it starts and ends on time
+void feedDht() {
+  while (nextDhtUs <= sim::nowUs() + DHT_STEP_US) {
+    uint32_t daySecond = (START_EPOCH + nextDhtUs / 1000000) % 86400UL;
+    sim::dhtReading(nextDhtUs, modelTemperature(daySecond), 550);
+    nextDhtUs += DHT_STEP_US;
+  }
+}
+
+void setUp() {
+  // Midnight daily, 07:30 on weekdays, 23:59 once (two minutes in)
+  alarms[0] = {0, 0, ALARM_EVERY_DAY, true};
+  alarms[1] = {7, 30, 0x1F, true};
+  alarms[2] = {23, 59, 0, true};
+  alarms[3].enabled = false;
+  computeNextAlarm();
+  autoModeSwitch = true;
+
+  // Expected rings from the calendar, minute by minute; weekdays come
+  // from epochToTime() rather than the scheduler's own arithmetic
+  expectedDay.assign(days + 1, 0);
+  bool onceDone = false;
+  for (uint32_t m = 0; m < days * 1440; m++) {
+    Time t;
+    epochToTime(START_EPOCH + m * 60, t);
+    for (uint8_t i = 0; i < 3; i++) {
+      const AlarmData &a = alarms[i];
+      if (t.hour != a.hour || t.min != a.minute) continue;
+      if (a.days == 0 ? onceDone : !(a.days & (1 << (t.dow - 1)))) continue;
+      if (a.days == 0) onceDone = true;
+      expectedRings++;
+      expectedDay[(START_EPOCH + m * 60) / 86400UL - START_EPOCH / 86400UL]++;
+    }
+  }
+
+  displayFreshUs = sim::nowUs();
+  printf("[SOAK] %u days in %ums steps, %u alarm rings expected\n", days, STEP_MS, expectedRings);
+}
+
+void reportDay() {
+  printf("[SOAK] day %u: %u rings, %u temp warnings, hr max %d\n",
+    day, dayRings, dayWarnings, dayHeartRate);
+
+  char what[48];
+  if (day <= days && dayRings != expectedDay[day]) {
+    snprintf(what, sizeof(what), "%u alarm rings, expected %u", dayRings, expectedDay[day]);
+    fail(what);
+  }
+  // Day 0 is the two minutes before the first midnight
+  if (day > 0 && dayWarnings == 0) fail("no temperature warning in the heat spell");
+  day++;
+  dayRings = 0;
+  dayWarnings = 0;
+  dayHeartRate = 0;
+}
+
+// Runs after every loop() pass
+void check() {
+  char what[64];
+  const Time &t = clockNow();
+
+  // The sketch only sees the RTC in whole seconds, so its clock may trail
+  // by the phase it read it at on top of the second either side
+  uint32_t rtc = START_EPOCH + sim::nowUs() / 1000000;
+  if (clockEpoch < lastEpoch || clockEpoch + 2 < rtc || clockEpoch > rtc + 1) {
+    snprintf(what, sizeof(what), "clock %u, RTC %u", clockEpoch, rtc);
+    fail(what);
+  }
+  lastEpoch = clockEpoch;
+
+  uint32_t today = clockEpoch / 86400UL;
+  if (today != calendarDay) {
+    if (calendarDay) reportDay();
+    calendarDay = today;
+  }
+
+  if (alarmRinging && !wasRinging) {
+    rings++;
+    dayRings++;
+    ringStartUs = sim::nowUs();
+    const AlarmData &a = alarms[ringingAlarm];
+    if (t.hour != a.hour || t.min != a.minute || t.sec > 2) {
+      snprintf(what, sizeof(what), "alarm %u (%02d:%02d) rang", ringingAlarm + 1, a.hour, a.minute);
+      fail(what);
+    }
+    pressed = rings % 2 == 1;
+    if (pressed) sim::press(sim::nowUs() + PRESS_DELAY * 1000ULL, 100);
+  } else if (!alarmRinging && wasRinging) {
+    uint32_t rang = (sim::nowUs() - ringStartUs) / 1000;
+    uint32_t limit = pressed ? PRESS_DELAY + 1000 : ALARM_DURATION + 1000;
+    if (rang > limit) {
+      snprintf(what, sizeof(what), "alarm rang %ums, limit %ums", rang, limit);
+      fail(what);
+    }
+  }
+  wasRinging = alarmRinging;
+
+  const HealthRule &rule = healthRules[RULE_TEMP_HIGH];
+  const HealthRuleState &temp = ruleState[RULE_TEMP_HIGH];
+  if (temp.triggers != warnings) {
+    if (warnings > 0 && temp.lastFired - lastWarning < rule.cooldown * 1000UL) {
+      snprintf(what, sizeof(what), "temp warnings %lums apart", temp.lastFired - lastWarning);
+      fail(what);
+    }
+    dayWarnings += temp.triggers - warnings;
+    warnings = temp.triggers;
+    lastWarning = temp.lastFired;
+  }
+
+  if (heartRate > dayHeartRate) dayHeartRate = heartRate;
+
+  // What the LCD model shows, not what the sketch meant to draw
+  if (displayMode == 0 && !overlayActive) {
+    std::string shown = sim::lcdText(0).substr(0, 8);
+    char expected[9];
+    formatTime(expected, sizeof(expected));
+    if (shown == expected) {
+      displayFreshUs = sim::nowUs();
+    } else if (sim::nowUs() - displayFreshUs > (1000 + STEP_MS) * 1000ULL) {
+      snprintf(what, sizeof(what), "time page shows %s", shown.c_str());
+      fail(what);
+      displayFreshUs = sim::nowUs();
+    }
+  } else {
+    displayFreshUs = sim::nowUs();
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // --days is ours; everything else goes to the simulator
+  std::vector<char*> simArgs = {argv[0]};
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--days") == 0 && i + 1 < argc) {
+      days = atoi(argv[++i]);
+    } else {
+      simArgs.push_back(argv[i]);
+    }
+  }
+  if (days == 0 || days > 48) {
+    fprintf(stderr, "soak: --days must be 1 to 48 (millis() wraps once)\n");
+    return 2;
+  }
+
+  sim::scenario.rtcStart = START_TIME;
+  sim::scenario.stepUs = STEP_MS * 1000;
+  sim::scenario.uptimeUs = UPTIME_MS * 1000;
+  sim::scenario.seconds = days * 86400.0 + 1;
+  for (uint32_t d = 0; d <= days; d++) {
+    // 08:00-08:05 of every calendar day; the run starts at 23:58
+    uint64_t start = (120 + d * 86400ULL + 8 * 3600) * 1000000;
+    sim::scenario.fingers.push_back({{start, start + 300000000}, 72});
+  }
+  if (!sim::begin(simArgs.size(), simArgs.data())) return 2;
+  feedDht();
+
+  setup();
+  setUp();
+  while (!sim::done()) {
+    loop();
+    sim::lcdPass();
+    check();
+    sim::spend(sim::scenario.stepUs);
+    feedDht();
+  }
+  reportDay();
+  if (rings != expectedRings) {
+    char what[48];
+    snprintf(what, sizeof(what), "%u alarm rings, expected %u", rings, expectedRings);
+    fail(what);
+  }
+
+  double host = sim::hostSeconds();
+  printf("[SOAK] %u days in %.3fs host, %.0fx speedup\n", days, host, sim::nowUs() / 1e6 / host);
+  printf("[SOAK] %u rings, %u temp warnings\n", rings, warnings);
+  sim::finish();
+  if (failures) {
+    printf("[SOAK] FAILED: %u checks\n", failures);
+    return 1;
+  }
+  printf("[SOAK] PASSED\n");
+  return 0;
+}
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Generates the labelled PPG traces in this directory.
+
+Each trace is 60 s of MAX30102 samples at 100 Hz in the tools/trace.py
+layout (a HEADER record, then PPG records of 4 samples), with a .labels
+file next to it: one "time_ms bpm" line per second giving the true rate
+at that moment, 0 while no finger is on the sensor.
+
+  rest      66 BPM with breathing (sinus arrhythmia, +-4 BPM at 0.25 Hz)
+  recovery  after exercise, 132 BPM falling towards 96, weaker pulse
+  motion    74 BPM with two hand movements and the finger lifted 27-30 s
+
+The signals are synthetic but shaped like real reflected IR: DC around
+110000, each beat a fast systolic dip with slow recovery and a dicrotic
+notch, breathing drift and noise. Fixed seeds keep the files stable.
+
+  synth.py [DIR]      # rewrite the traces, default: next to this script
+"""
+import math
+import os
+import random
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools"))
+from trace import SYNC, VERSION, crc8  # noqa: E402
+
+RATE_HZ = 100
+SECONDS = 60
+BURST = 4   # Samples per PPG record, as the sketch reads the FIFO
+
+
+def frame(ftype, time_ms, payload):
+    body = struct.pack("<BBI", ftype, len(payload), time_ms) + payload
+    return bytes([SYNC]) + body + bytes([crc8(body)])
+
+
+def pulse(phase):
+    """Blood volume over one beat, 0..1."""
+    if phase < 0.12:
+        return math.sin(math.pi / 2 * phase / 0.12)
+    return math.exp(-(phase - 0.12) * 5) + 0.15 * math.exp(-((phase - 0.45) / 0.05) ** 2)
+
+
+def rest(t):
+    return 66 + 4 * math.sin(2 * math.pi * 0.25 * t)
+
+
+def recovery(t):
+    return 96 + 36 * math.exp(-t / 25)
+
+
+def motion(t):
+    return 74 + 2 * math.sin(2 * math.pi * 0.2 * t)
+
+
+# name: (rate(t), pulse depth, noise, finger-off windows, artefact(t, rng))
+TRACES = {
+    "rest": (rest, 900, 40, [], None),
+    "recovery": (recovery, 600, 60, [], None),
+    "motion": (motion, 800, 50, [(27.0, 30.0)],
+               lambda t: (3500 * math.sin(2 * math.pi * 1.3 * t) if 12.0 <= t < 14.0 else 0)
+               + (2500 * math.exp(-(t - 42.0) * 2) if t >= 42.0 else 0)),
+}
+
+
+def synthesize(name, seed):
+    rate, depth, noise, off, artefact = TRACES[name]
+    rng = random.Random(seed)
+    phase = 0.0
+    samples = []
+    labels = []
+    for n in range(SECONDS * RATE_HZ):
+        t = n / RATE_HZ
+        finger = not any(a <= t < b for a, b in off)
+        phase = (phase + rate(t) / 60 / RATE_HZ) % 1.0
+        if finger:
+            drift = 300 * math.sin(2 * math.pi * 0.25 * t + 1.0)
+            ir = 110000 + drift - depth * pulse(phase) + rng.gauss(0, noise / 2)
+            if artefact:
+                ir += artefact(t)
+            red = ir * 0.8 + rng.gauss(0, noise / 2)
+        else:
+            ir = 3000 + rng.gauss(0, 100)
+            red = 2500 + rng.gauss(0, 100)
+        samples.append((int(red) & 0x3FFFF, int(ir) & 0x3FFFF))
+        if n % RATE_HZ == 0:
+            labels.append((n * 1000 // RATE_HZ, rate(t) if finger else 0))
+
+    out = bytearray(frame(0, 0, bytes([VERSION])))
+    for first in range(0, len(samples), BURST):
+        burst = samples[first:first + BURST]
+        payload = bytes([len(burst)])
+        for red, ir in burst:
+            payload += red.to_bytes(3, "little") + ir.to_bytes(3, "little")
+        out += frame(1, (first + len(burst)) * 1000 // RATE_HZ, payload)
+    return bytes(out), labels
+
+
+def main():
+    directory = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__))
+    for seed, name in enumerate(TRACES, 1):
+        data, labels = synthesize(name, seed)
+        with open(os.path.join(directory, name + ".trace"), "wb") as f:
+            f.write(data)
+        with open(os.path.join(directory, name + ".labels"), "w") as f:
+            f.write("# time_ms bpm, %s\n" % name)
+            for time_ms, bpm in labels:
+                f.write("%d %.1f\n" % (time_ms, bpm))
+
+
+if __name__ == "__main__":
+    main()
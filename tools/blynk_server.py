@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Blynk cloud, for measuring the clock's traffic.
+
+Speaks enough of the Blynk hardware protocol to accept the device login,
+answer pings, log every frame and send virtual pin writes to the device.
+Build the sketch with BLYNK_LOCAL_SERVER set to this machine's address.
+
+  blynk_server.py serve                 # log frames; type "8 1" to write V8=1
+  blynk_server.py bench --minutes 2     # traffic and latency benchmark
+
+No internet connection or third-party packages needed.
+"""
+import argparse
+import asyncio
+import json
+import statistics
+import struct
+import sys
+import time
+
+CMD_RESPONSE = 0
+CMD_LOGIN = 2
+CMD_PING = 6
+CMD_HARDWARE = 20
+CMD_HW_LOGIN = 29
+CMD_NAMES = {0: "response", 2: "login", 6: "ping", 15: "bridge", 16: "sync", 17: "internal",
+             19: "property", 20: "hardware", 29: "hw_login", 55: "debug", 64: "event"}
+STATUS_OK = 200
+
+# Virtual pins, matching BLYNK VIRTUAL PINS in the sketch
+V_TIME, V_ALARM_HOUR, V_ALARM_MIN, V_ALARM_EN = 0, 5, 6, 7
+V_STOP_ALARM, V_STATUS, V_AUTO_MODE, V_SELECT_MODE, V_NEXT_MODE = 8, 9, 11, 12, 13
+V_ALARM_SLOT, V_ALARM_DAYS = 14, 15
+
+
+class Device:
+    """One connected device: frame reader, recorder and pin writer."""
+
+    def __init__(self, reader, writer, log):
+        self.reader = reader
+        self.writer = writer
+        self.log = log
+        self.msg_id = 0
+        self.frames = []        # (time, direction, cmd, bytes)
+        self.pins = {}          # Last value the device wrote per pin
+        self.waiters = []       # (predicate, future)
+        self.logged_in = asyncio.Event()
+
+    def record(self, direction, cmd, msg_id, body):
+        now = time.monotonic()
+        self.frames.append((now, direction, cmd, 5 + len(body)))
+        if self.log:
+            text = body.replace(b"\0", b" ").decode("utf-8", "replace")
+            self.log.write(json.dumps({"t": round(now, 4), "dir": direction,
+                                       "cmd": CMD_NAMES.get(cmd, cmd), "id": msg_id,
+                                       "body": text}) + "\n")
+
+    def send(self, cmd, body=b"", msg_id=None, status=None):
+        if msg_id is None:
+            self.msg_id = self.msg_id % 0xFFFF + 1
+            msg_id = self.msg_id
+        length = status if status is not None else len(body)
+        self.writer.write(struct.pack(">BHH", cmd, msg_id, length) + body)
+        self.record("out", cmd, msg_id, body)
+
+    def virtual_write(self, pin, value):
+        self.send(CMD_HARDWARE, b"vw\0%d\0%s" % (pin, str(value).encode()))
+
+    def wait_for(self, predicate, timeout):
+        future = asyncio.get_running_loop().create_future()
+        self.waiters.append((predicate, future))
+        return asyncio.wait_for(future, timeout)
+
+    async def run(self):
+        try:
+            while True:
+                header = await self.reader.readexactly(5)
+                cmd, msg_id, length = struct.unpack(">BHH", header)
+                body = b"" if cmd == CMD_RESPONSE else await self.reader.readexactly(length)
+                self.record("in", cmd, msg_id, body)
+                self.handle(cmd, msg_id, body)
+        except (asyncio.IncompleteReadError, ConnectionError):
+            print("[server] device disconnected", file=sys.stderr)
+        except asyncio.CancelledError:
+            pass   # Server shutting down
+
+    def handle(self, cmd, msg_id, body):
+        if cmd in (CMD_LOGIN, CMD_HW_LOGIN):
+            self.send(CMD_RESPONSE, msg_id=msg_id, status=STATUS_OK)
+            self.logged_in.set()
+            print("[server] device logged in", file=sys.stderr)
+        elif cmd == CMD_PING:
+            self.send(CMD_RESPONSE, msg_id=msg_id, status=STATUS_OK)
+        elif cmd == CMD_HARDWARE:
+            parts = body.split(b"\0")
+            if len(parts) >= 3 and parts[0] == b"vw":
+                pin = int(parts[1])
+                value = b"\0".join(parts[2:]).decode("utf-8", "replace")
+                self.pins[pin] = value
+                for waiter in list(self.waiters):
+                    predicate, future = waiter
+                    if not future.done() and predicate(pin, value):
+                        future.set_result(time.monotonic())
+                        self.waiters.remove(waiter)
+
+
+async def accept_device(port, log):
+    """Starts the server and returns the first device that logs in."""
+    connected = asyncio.get_running_loop().create_future()
+
+    async def on_connect(reader, writer):
+        print("[server] connection from %s:%d" % writer.get_extra_info("peername")[:2], file=sys.stderr)
+        device = Device(reader, writer, log)
+        if not connected.done():
+            connected.set_result(device)
+        await device.run()
+
+    server = await asyncio.start_server(on_connect, "0.0.0.0", port)
+    print("[server] listening on port %d" % port, file=sys.stderr)
+    device = await connected
+    await device.logged_in.wait()
+    return server, device
+
+
+async def serve(args):
+    log = open(args.log, "a") if args.log else sys.stdout
+    server, device = await accept_device(args.port, log)
+    loop = asyncio.get_running_loop()
+    reader = asyncio.StreamReader()
+    await loop.connect_read_pipe(lambda: asyncio.StreamReaderProtocol(reader), sys.stdin)
+    # Each stdin line "<pin> <value>" becomes a write to that virtual pin
+    while line := await reader.readline():
+        fields = line.decode().split()
+        if len(fields) == 2 and fields[0].lstrip("Vv").isdigit():
+            device.virtual_write(int(fields[0].lstrip("Vv")), fields[1])
+    server.close()
+
+
+def summarize(name, samples):
+    if not samples:
+        print("%-12s no samples" % name)
+        return
+    print("%-12s n=%d min=%.1fms median=%.1fms max=%.1fms" % (
+        name, len(samples), min(samples), statistics.median(samples), max(samples)))
+
+
+async def mode_latency(device, rounds):
+    """V_NEXT_MODE from the app until the device reports the new mode."""
+    samples = []
+    for _ in range(rounds):
+        sent = time.monotonic()
+        done = device.wait_for(lambda pin, value: pin == V_SELECT_MODE, 5)
+        device.virtual_write(V_NEXT_MODE, 1)
+        try:
+            samples.append((await done - sent) * 1000)
+        except asyncio.TimeoutError:
+            print("[bench] mode switch timed out", file=sys.stderr)
+        await asyncio.sleep(0.5)
+    return samples
+
+
+async def stop_alarm_latency(device, rounds):
+    """V_STOP_ALARM until the status leaves "ringing".
+
+    stopAlarmSound() turns the buzzer off before it publishes the status,
+    so this is an upper bound on command-to-silence. Each round arms alarm
+    slot 1 for the next minute of the device clock and waits for it.
+    """
+    samples = []
+    for _ in range(rounds):
+        clock = device.pins.get(V_TIME)
+        if not clock:
+            await device.wait_for(lambda pin, value: pin == V_TIME, 10)
+            clock = device.pins[V_TIME]
+        hour, minute, second = (int(x) for x in clock.split(":"))
+        minute += 2 if second >= 50 else 1   # Leave time for the writes
+        hour, minute = (hour + minute // 60) % 24, minute % 60
+
+        ringing = device.wait_for(lambda pin, value: pin == V_STATUS and "RINGING" in value, 90)
+        for pin, value in ((V_ALARM_SLOT, 0), (V_ALARM_HOUR, hour), (V_ALARM_MIN, minute),
+                           (V_ALARM_DAYS, 0x7F), (V_ALARM_EN, 1)):
+            device.virtual_write(pin, value)
+        print("[bench] alarm set for %02d:%02d, waiting" % (hour, minute), file=sys.stderr)
+        try:
+            await ringing
+        except asyncio.TimeoutError:
+            print("[bench] alarm never rang", file=sys.stderr)
+            continue
+
+        sent = time.monotonic()
+        stopped = device.wait_for(lambda pin, value: pin == V_STATUS and "RINGING" not in value, 5)
+        device.virtual_write(V_STOP_ALARM, 1)
+        try:
+            samples.append((await stopped - sent) * 1000)
+        except asyncio.TimeoutError:
+            print("[bench] stop timed out", file=sys.stderr)
+    device.virtual_write(V_ALARM_EN, 0)
+    return samples
+
+
+async def bench(args):
+    log = open(args.log, "w") if args.log else None
+    server, device = await accept_device(args.port, log)
+    device.virtual_write(V_AUTO_MODE, 0)   # Keep the status line still
+
+    print("[bench] measuring idle traffic for %g min" % args.minutes, file=sys.stderr)
+    start = time.monotonic()
+    await asyncio.sleep(args.minutes * 60)
+    inbound = [f for f in device.frames if f[1] == "in" and f[0] >= start]
+    per_cmd = {}
+    for _, _, cmd, size in inbound:
+        count, total = per_cmd.get(cmd, (0, 0))
+        per_cmd[cmd] = (count + 1, total + size)
+
+    mode = await mode_latency(device, args.rounds)
+    stop = await stop_alarm_latency(device, args.alarm_rounds)
+
+    print("\ndevice -> server over %g min" % args.minutes)
+    print("frames/min   %.1f" % (len(inbound) / args.minutes))
+    print("bytes/min    %.0f" % (sum(f[3] for f in inbound) / args.minutes))
+    for cmd, (count, total) in sorted(per_cmd.items()):
+        print("  %-10s %6.1f frames/min %7.0f B/min" % (
+            CMD_NAMES.get(cmd, cmd), count / args.minutes, total / args.minutes))
+    print("\nround trip")
+    summarize("next mode", mode)
+    summarize("stop alarm", stop)
+    server.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("serve", help="log frames and forward pin writes typed on stdin")
+    p.add_argument("--port", type=int, default=8080)
+    p.add_argument("--log", help="append frames as JSON lines here (default stdout)")
+    p.set_defaults(func=serve)
+
+    p = sub.add_parser("bench", help="measure traffic and command latency")
+    p.add_argument("--port", type=int, default=8080)
+    p.add_argument("--minutes", type=float, default=2)
+    p.add_argument("--rounds", type=int, default=20, help="next-mode round trips")
+    p.add_argument("--alarm-rounds", type=int, default=1, help="stop-alarm round trips")
+    p.add_argument("--log", help="write every frame as JSON lines here")
+    p.set_defaults(func=bench)
+
+    args = parser.parse_args()
+    asyncio.run(args.func(args))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Capture, inspect and replay sensor traces from the smart clock.
+
+Build the sketch with TRACE_RECORD to capture, or TRACE_REPLAY to feed a
+capture back in. The record layout is documented in the sketch under
+TRACE RECORDER.
+
+  trace.py capture /dev/ttyUSB0 run.trace     # Ctrl+C to stop
+  trace.py dump run.trace
+  trace.py replay run.trace /dev/ttyUSB0
+
+Needs pyserial for capture and replay.
+"""
+import argparse
+import struct
+import sys
+import time
+
+SYNC = 0xA5
+VERSION = 3
+BAUD = 921600
+TYPES = {0: "HEADER", 1: "PPG", 2: "DHT", 3: "RTC", 4: "BUTTON", 5: "BLYNK"}
+
+
+def crc8(data, crc=0):
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def frames(data):
+    """Yields (type, time_ms, payload, raw) for every valid frame in data."""
+    i = 0
+    while i + 8 <= len(data):
+        if data[i] != SYNC:
+            i += 1
+            continue
+        length = data[i + 2]
+        end = i + 8 + length
+        raw = data[i:end]
+        if end > len(data) or crc8(raw[1:-1]) != raw[-1]:
+            i += 1
+            continue
+        ftype = raw[1]
+        (ftime,) = struct.unpack_from("<I", raw, 3)
+        yield ftype, ftime, raw[7:-1], raw
+        i = end
+
+
+def describe(ftype, payload):
+    if ftype == 0:
+        return "version %d" % payload[0]
+    if ftype == 1:
+        count = payload[0]
+        samples = []
+        for n in range(count):
+            red = int.from_bytes(payload[1 + n * 6:4 + n * 6], "little")
+            ir = int.from_bytes(payload[4 + n * 6:7 + n * 6], "little")
+            samples.append("%d/%d" % (ir, red))
+        return "%d samples ir/red %s" % (count, " ".join(samples))
+    if ftype == 2:
+        ok, hum, temp = struct.unpack("<Bhh", payload)
+        return "ok=%d humidity=%.1f temp=%.1f" % (ok, hum / 10, temp / 10)
+    if ftype == 3:
+        year, mon, date, hour, minute, sec, dow = struct.unpack("<H6B", payload)
+        return "%04d-%02d-%02d %02d:%02d:%02d dow=%d" % (year, mon, date, hour, minute, sec, dow)
+    if ftype == 4:
+        level, edge = struct.unpack("<BI", payload)
+        return "level=%d edge=%dms" % (level, edge)
+    if ftype == 5:
+        pin, value = struct.unpack("<Bi", payload)
+        return "V%d=%d" % (pin, value)
+    return payload.hex()
+
+
+def capture(args):
+    import serial
+
+    with serial.Serial(args.port, args.baud) as port, open(args.file, "wb") as out:
+        total = 0
+        try:
+            while True:
+                chunk = port.read(port.in_waiting or 1)
+                out.write(chunk)
+                total += len(chunk)
+        except KeyboardInterrupt:
+            pass
+    print("captured %d bytes" % total, file=sys.stderr)
+
+
+def dump(args):
+    data = open(args.file, "rb").read()
+    for ftype, ftime, payload, _ in frames(data):
+        print("%10d %-6s %s" % (ftime, TYPES.get(ftype, "?%d" % ftype), describe(ftype, payload)))
+
+
+def replay(args):
+    import serial
+
+    data = open(args.file, "rb").read()
+    with serial.Serial(args.port, args.baud) as port:
+        start = None
+        # Send each frame slightly ahead of its due time; the sketch holds
+        # one frame and applies it when its own clock catches up
+        lead = args.lead / 1000.0
+        for ftype, ftime, payload, raw in frames(data):
+            if ftype == 0:
+                if payload[0] != VERSION:
+                    sys.exit("unsupported trace version %d" % payload[0])
+                start = None
+            if start is None:
+                start = time.monotonic() - ftime / 1000.0
+            delay = start + ftime / 1000.0 - lead - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            port.write(raw)
+            if port.in_waiting:
+                sys.stdout.buffer.write(port.read(port.in_waiting))
+                sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("capture", help="save the serial stream of a TRACE_RECORD build")
+    p.add_argument("port")
+    p.add_argument("file")
+    p.add_argument("--baud", type=int, default=BAUD)
+    p.set_defaults(func=capture)
+
+    p = sub.add_parser("dump", help="print the records of a capture")
+    p.add_argument("file")
+    p.set_defaults(func=dump)
+
+    p = sub.add_parser("replay", help="feed a capture into a TRACE_REPLAY build")
+    p.add_argument("file")
+    p.add_argument("port")
+    p.add_argument("--baud", type=int, default=BAUD)
+    p.add_argument("--lead", type=int, default=50, help="ms to send frames ahead of time")
+    p.set_defaults(func=replay)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()